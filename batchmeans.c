@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "batchmeans.h"
+
+/* ******************************************************************
+   Batch means estimates (see batchmeans.h).
+
+   The first message delivered after the warm-up only starts the first
+   batch, so that every batch covers the time between batchsize
+   deliveries.
+**********************************************************************/
+
+double t95(int df)
+{
+  /* two-sided 95% quantiles of Student's t distribution, by degrees of freedom */
+  static const double t[] = { 0.0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365,
+                              2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131,
+                              2.120, 2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069,
+                              2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+  if (df < 31)
+    return t[df];
+  return 1.960;
+}
+
+void batchmeans_init(struct batchmeans *bm, double warmup, double precision)
+{
+  memset(bm, 0, sizeof(*bm));
+  bm->warmup = warmup;
+  bm->precision = precision;
+  bm->batchsize = BM_BATCHSIZE;
+}
+
+void batchmeans_accept(struct batchmeans *bm, double time)
+{
+  if (bm->npending == BM_MAXPENDING) {
+    printf("more than %d messages awaiting delivery for the batch means.", BM_MAXPENDING);
+    exit(EXIT_FAILURE);
+  }
+  bm->accepted[(bm->first + bm->npending) % BM_MAXPENDING] = time;
+  bm->npending++;
+}
+
+/* the observation of an estimate in batch b */
+static double observation(const struct batchmeans *bm, const struct batch *b, int estimate)
+{
+  switch (estimate) {
+  case BM_GOODPUT:
+    return b->duration > 0.0 ? bm->batchsize / b->duration : 0.0;
+  case BM_LATENCY:
+    return b->latency / bm->batchsize;
+  default:
+    return (double)b->resent / bm->batchsize;
+  }
+}
+
+void batchmeans_estimates(const struct batchmeans *bm, double mean[BM_NESTIMATES],
+                          double halfwidth[BM_NESTIMATES])
+{
+  double x, var;
+  int i, k, n = bm->nbatches;
+
+  for (k=0; k<BM_NESTIMATES; k++) {
+    mean[k] = 0.0;
+    halfwidth[k] = 0.0;
+    for (i=0; i<n; i++)
+      mean[k] += observation(bm, &bm->batches[i], k);
+    if (n > 0)
+      mean[k] /= n;
+    if (n < 2)
+      continue;
+    var = 0.0;
+    for (i=0; i<n; i++) {
+      x = observation(bm, &bm->batches[i], k) - mean[k];
+      var += x * x;
+    }
+    var /= n - 1;
+    halfwidth[k] = t95(n - 1) * sqrt(var / n);
+  }
+}
+
+/* have the estimates reached the precision? */
+static int precise(const struct batchmeans *bm)
+{
+  double mean[BM_NESTIMATES], halfwidth[BM_NESTIMATES];
+  int k;
+
+  if (bm->nbatches < BM_MINBATCHES)
+    return 0;
+  batchmeans_estimates(bm, mean, halfwidth);
+  for (k=0; k<BM_NESTIMATES; k++)
+    if (halfwidth[k] > bm->precision * fabs(mean[k]))
+      return 0;
+  return 1;
+}
+
+/* complete the current batch, merging the batches in pairs if there is no room for it */
+static void endbatch(struct batchmeans *bm, double time, int resent)
+{
+  struct batch *b;
+  int i;
+
+  if (bm->nbatches == BM_MAXBATCHES) {
+    for (i=0; i<BM_MAXBATCHES/2; i++) {
+      b = &bm->batches[i];
+      *b = bm->batches[2*i];
+      b->duration += bm->batches[2*i + 1].duration;
+      b->latency += bm->batches[2*i + 1].latency;
+      b->resent += bm->batches[2*i + 1].resent;
+    }
+    bm->nbatches = BM_MAXBATCHES/2;
+    bm->batchsize *= 2;
+    if (bm->ncurrent < bm->batchsize)
+      return;       /* the current batch is only half of the new size */
+  }
+  bm->current.duration = time - bm->start;
+  bm->current.resent = resent - bm->resent;
+  bm->batches[bm->nbatches++] = bm->current;
+  memset(&bm->current, 0, sizeof(bm->current));
+  bm->ncurrent = 0;
+  bm->start = time;
+  bm->resent = resent;
+}
+
+int batchmeans_deliver(struct batchmeans *bm, double time, int resent)
+{
+  double accepted;
+
+  if (bm->npending == 0)
+    return bm->done;        /* accepted before the estimates were kept */
+  accepted = bm->accepted[bm->first];
+  bm->first = (bm->first + 1) % BM_MAXPENDING;
+  bm->npending--;
+
+  if (!bm->started) {
+    if (time < bm->warmup)
+      return 0;
+    bm->started = 1;
+    bm->start = time;
+    bm->resent = resent;
+    return 0;
+  }
+
+  bm->current.latency += time - accepted;
+  if (++bm->ncurrent < bm->batchsize)
+    return bm->done;
+  endbatch(bm, time, resent);
+  if (!bm->done && precise(bm))
+    bm->done = 1;
+  return bm->done;
+}
@@ -0,0 +1,70 @@
+/* ******************************************************************
+   Batch means estimates of a run, used to stop it once they are
+   precise enough.
+
+   After the warm-up, the messages delivered at B are grouped into
+   batches of batchsize consecutive messages, and each batch gives one
+   observation of
+   - goodput: messages delivered per time unit
+   - latency: mean time from A accepting a message to its delivery
+   - resends: packets resent by A per message delivered
+   The batch means are taken as independent, so each estimate is their
+   mean with a 95% confidence interval from Student's t distribution.
+   Once BM_MAXBATCHES batches are complete, neighbouring batches are
+   merged and batchsize doubles, so the batches grow with the run and
+   their correlation shrinks.
+
+   The run is precise enough once it has BM_MINBATCHES batches and the
+   half-width of every interval is at most precision times its mean.
+**********************************************************************/
+
+#define BM_MINBATCHES  10     /* batches before the precision is checked */
+#define BM_MAXBATCHES  64     /* batches kept, merged in pairs beyond that */
+#define BM_BATCHSIZE   16     /* messages per batch at first */
+#define BM_MAXPENDING  256    /* messages accepted by A and not yet delivered */
+
+/* the estimates */
+#define BM_GOODPUT     0
+#define BM_LATENCY     1
+#define BM_RESENDS     2
+#define BM_NESTIMATES  3
+
+struct batch {
+  double duration;        /* time from the end of the previous batch */
+  double latency;         /* total latency of its messages */
+  int resent;             /* packets resent during it */
+};
+
+struct batchmeans {
+  double warmup;          /* observations before this time are dropped */
+  double precision;       /* relative half-width wanted, 0 for no estimates */
+  double accepted[BM_MAXPENDING];  /* acceptance times of the messages in flight, oldest first */
+  int first, npending;
+  int started;            /* the warm-up is over */
+  int batchsize;
+  int nbatches;           /* complete batches */
+  struct batch batches[BM_MAXBATCHES];
+  struct batch current;   /* the batch being filled */
+  int ncurrent;           /* messages delivered in it */
+  double start;           /* time at which it started */
+  int resent;             /* resends before it started */
+  int done;               /* the estimates are precise enough */
+};
+
+/* start the estimates of a new run */
+extern void batchmeans_init(struct batchmeans *, double warmup, double precision);
+
+/* A accepted a message at time */
+extern void batchmeans_accept(struct batchmeans *, double time);
+
+/* B delivered a message at time, after a total of resent resends by A;
+   return 1 once the estimates are precise enough */
+extern int batchmeans_deliver(struct batchmeans *, double time, int resent);
+
+/* the mean and 95% confidence interval half-width of every estimate,
+   0 if there are fewer than two batches */
+extern void batchmeans_estimates(const struct batchmeans *, double mean[BM_NESTIMATES],
+                                 double halfwidth[BM_NESTIMATES]);
+
+/* two-sided 95% quantile of Student's t distribution with df degrees of freedom */
+extern double t95(int df);
@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../emulator.h"
+#include "../gbn.h"
+#include "../simulator.h"
+#include "../rng.h"
+
+/* ******************************************************************
+   Benchmarks of the emulator and protocol hot paths.
+
+   Each benchmark is run REPEAT times at a fixed seed and size and
+   reports the fastest run's ns/op and ops/sec (for the end-to-end
+   simulations an op is one event).
+   The end-to-end simulations send 10^3, 10^4, ... messages with 10%
+   loss and corruption in both directions.
+   If a baseline file is given, a benchmark fails when its ns/op is
+   more than tolerance above the recorded value.  Benchmarks recorded
+   at under MIN_GATED ns/op are too short to time reliably; they are
+   reported but never fail.
+
+   usage: bench [-m maxmsgs] [-b baseline] [-u] [-t tolerance]
+   -m maxmsgs   largest end-to-end simulation, 10^3 up to 10^7 (default 10^5)
+   -b baseline  baseline file of "name ns/op" lines
+   -u           write the results to the baseline file instead of comparing
+   -t tolerance allowed slowdown as a fraction of the baseline (default 0.5)
+**********************************************************************/
+
+#define SEED 9999
+#define DEPTH 16           /* events kept in the list by the micro benchmarks */
+#define MICRO_OPS 1000000L
+#define LAMBDA 50.0        /* low enough load that the channel does not back up */
+#define MAXBENCH 32
+#define REPEAT 3           /* runs of each benchmark, the fastest is reported */
+#define MIN_GATED 20.0     /* ns/op of the shortest benchmark that can fail */
+
+extern int ComputeChecksum(struct pkt);
+
+struct result {
+  char name[32];
+  long ops;
+  double ns;               /* total run time */
+};
+
+static struct result results[MAXBENCH];
+static int nresults;
+static volatile int sink;  /* keeps results of benchmarked calls alive */
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void sim_params(struct sim_params *params, int nsimmax, float lossprob, float corruptprob)
+{
+  memset(params, 0, sizeof(*params));
+  params->nsimmax = nsimmax;
+  params->lossprob = lossprob;
+  params->corruptprob = corruptprob;
+  params->corruptdirection = 2;
+  params->lambda = LAMBDA;
+  params->trace = 0;
+  params->seed = SEED;
+}
+
+static void start_sim(int nsimmax, float lossprob, float corruptprob)
+{
+  struct sim_params params;
+
+  sim_params(&params, nsimmax, lossprob, corruptprob);
+  init_params(&params);
+}
+
+/* keep the fastest of the runs of each benchmark */
+static void record(const char *name, long ops, double ns)
+{
+  struct result *r;
+  int i;
+
+  for (i=0; i<nresults; i++)
+    if (strcmp(results[i].name, name) == 0)
+      break;
+  r = &results[i];
+  if (i == nresults) {
+    nresults++;
+    snprintf(r->name, sizeof(r->name), "%s", name);
+  }
+  else if (ns / ops >= r->ns / r->ops)
+    return;
+  r->ops = ops;
+  r->ns = ns;
+}
+
+static void print_results(void)
+{
+  struct result *r;
+  int i;
+
+  for (i=0; i<nresults; i++) {
+    r = &results[i];
+    printf("%-24s %10ld ops %10.1f ns/op %14.0f ops/sec\n", r->name, r->ops, r->ns / r->ops, r->ops * 1e9 / r->ns);
+  }
+}
+
+/* remove and free every event in the event list */
+static void drain_evlist(void)
+{
+  struct event *q;
+
+  while (evlist != NULL) {
+    q = evlist;
+    evlist = evlist->next;
+    if (q->evtype == FROM_LAYER3)
+      free(q->pktptr);
+    free(q);
+  }
+}
+
+/* fill the event list with DEPTH events that are never simulated */
+static void fill_evlist(void)
+{
+  struct event *evptr;
+  int i;
+
+  for (i=0; i<DEPTH; i++) {
+    evptr = malloc(sizeof(struct event));
+    evptr->evtime = 10 * jimsrand();
+    evptr->evtype = FROM_LAYER5;
+    evptr->eventity = A;
+    evptr->pktptr = NULL;
+    insertevent(evptr);
+  }
+}
+
+/* hold model: pop the first event and insert it again further in the future */
+static void bench_insertevent(void)
+{
+  struct event *evptr;
+  double start;
+  long i;
+
+  start_sim(0, 0.0, 0.0);
+  fill_evlist();
+  start = now_ns();
+  for (i=0; i<MICRO_OPS; i++) {
+    evptr = evlist;
+    evlist = evlist->next;
+    evlist->prev = NULL;
+    evptr->evtime += 1 + 9*jimsrand();
+    insertevent(evptr);
+  }
+  record("insertevent", MICRO_OPS, now_ns() - start);
+}
+
+static void bench_timer(void)
+{
+  double start;
+  long i;
+
+  start_sim(0, 0.0, 0.0);
+  fill_evlist();
+  start = now_ns();
+  for (i=0; i<MICRO_OPS; i++) {
+    starttimer(A, 16.0);
+    stoptimer(A);
+  }
+  record("starttimer+stoptimer", MICRO_OPS, now_ns() - start);
+}
+
+static void bench_tolayer3(void)
+{
+  struct pkt packet;
+  double start;
+  long i;
+
+  memset(&packet, 0, sizeof(packet));
+  start_sim(0, 0.1, 0.1);
+  start = now_ns();
+  for (i=0; i<MICRO_OPS; i++) {
+    if (i % DEPTH == 0)
+      drain_evlist();            /* drop the packets in flight */
+    packet.seqnum = i;
+    tolayer3(A, packet);
+  }
+  record("tolayer3", MICRO_OPS, now_ns() - start);
+}
+
+/* the same packets as bench_tolayer3, sent DEPTH at a time as in a window resend */
+static void bench_tolayer3_burst(void)
+{
+  struct pkt packets[DEPTH];
+  double start;
+  long i;
+  int j;
+
+  memset(packets, 0, sizeof(packets));
+  start_sim(0, 0.1, 0.1);
+  start = now_ns();
+  for (i=0; i<MICRO_OPS; i+=DEPTH) {
+    drain_evlist();              /* drop the packets in flight */
+    for (j=0; j<DEPTH; j++)
+      packets[j].seqnum = i + j;
+    tolayer3_burst(A, packets, DEPTH);
+  }
+  record("tolayer3_burst", MICRO_OPS, now_ns() - start);
+}
+
+static void bench_checksum(void)
+{
+  struct pkt packet;
+  double start;
+  long i;
+  int sum = 0;
+
+  memset(&packet, 'a', sizeof(packet));
+  start = now_ns();
+  for (i=0; i<MICRO_OPS; i++) {
+    packet.seqnum = i;
+    sum += ComputeChecksum(packet);
+  }
+  record("ComputeChecksum", MICRO_OPS, now_ns() - start);
+  sink = sum;
+}
+
+/* small simulations are repeated until MICRO_OPS events have been simulated */
+static void bench_simulation(int nsimmax)
+{
+  struct sim_stats stats;
+  char name[32];
+  double start;
+  long nevents = 0;
+
+  start = now_ns();
+  do {
+    start_sim(nsimmax, 0.1, 0.1);
+    A_init();
+    B_init();
+    run_simulation(-1);
+    get_statistics(&stats);
+    nevents += stats.nevents;
+  } while (nevents < MICRO_OPS);
+  snprintf(name, sizeof(name), "simulation-%d", nsimmax);
+  record(name, nevents, now_ns() - start);
+}
+
+/* the random numbers of RNG_LANES replications, from RNG_LANES scalar
+   generators and from one multi-lane generator */
+static void bench_rng(void)
+{
+  static uint32_t block[256][RNG_LANES];
+  struct rng scalar[RNG_LANES];
+  struct rng_lanes lanes;
+  unsigned int seeds[RNG_LANES];
+  double start;
+  long i;
+  int j, sum = 0;
+
+  for (j=0; j<RNG_LANES; j++) {
+    seeds[j] = SEED + j;
+    rng_seed(&scalar[j], seeds[j]);
+  }
+  start = now_ns();
+  for (j=0; j<RNG_LANES; j++)
+    for (i=0; i<MICRO_OPS/RNG_LANES; i++)
+      sum += rng_next(&scalar[j]);
+  record("rng_next", MICRO_OPS, now_ns() - start);
+
+  rng_lanes_seed(&lanes, seeds);
+  start = now_ns();
+  for (i=0; i<MICRO_OPS; i+=256*RNG_LANES) {
+    rng_lanes_fill(&lanes, block, 256);
+    sum += block[255][0];
+  }
+  record("rng_lanes_fill", MICRO_OPS, now_ns() - start);
+  sink = sum;
+}
+
+/* RNG_LANES replications of a simulation, one after another with the
+   scalar generator and then as a Monte Carlo run on the multi-lane one */
+static void bench_replications(int nsimmax)
+{
+  struct flow flows[RNG_LANES];
+  struct sim_stats stats;
+  double start;
+  long nevents = 0;
+  int i;
+
+  start = now_ns();
+  for (i=0; i<RNG_LANES; i++) {
+    sim_params(&flows[i].params, nsimmax, 0.1, 0.1);
+    flows[i].params.seed = SEED + i;
+    flows[i].congestion_control = 0;
+    init_params(&flows[i].params);
+    A_init();
+    B_init();
+    run_simulation(-1);
+    get_statistics(&stats);
+    nevents += stats.nevents;
+  }
+  record("replications-sequential", nevents, now_ns() - start);
+
+  start = now_ns();
+  montecarlo_run(flows, RNG_LANES, MONTECARLO_SLICE);
+  record("replications-montecarlo", nevents, now_ns() - start);
+}
+
+/* compare results with the baseline, return the number of regressions */
+static int compare_baseline(const char *file, double tolerance)
+{
+  FILE *fp;
+  char name[32];
+  double base, ns;
+  int i, found, regressions = 0;
+
+  fp = fopen(file, "r");
+  if (fp == NULL) {
+    printf("unable to open baseline file %s\n", file);
+    exit(EXIT_FAILURE);
+  }
+  while (fscanf(fp, "%31s %lf", name, &base) == 2) {
+    found = 0;
+    for (i=0; i<nresults; i++) {
+      if (strcmp(results[i].name, name) != 0)
+        continue;
+      found = 1;
+      ns = results[i].ns / results[i].ops;
+      if (base >= MIN_GATED && ns > base * (1 + tolerance)) {
+        printf("REGRESSION %-24s %10.1f ns/op, baseline %10.1f ns/op\n", name, ns, base);
+        regressions++;
+      }
+    }
+    if (!found)
+      printf("not run: %s\n", name);
+  }
+  fclose(fp);
+  return regressions;
+}
+
+static void write_baseline(const char *file)
+{
+  FILE *fp;
+  int i;
+
+  fp = fopen(file, "w");
+  if (fp == NULL) {
+    printf("unable to open baseline file %s\n", file);
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<nresults; i++)
+    fprintf(fp, "%s %.1f\n", results[i].name, results[i].ns / results[i].ops);
+  fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+  const char *baseline = NULL;
+  double tolerance = 0.5;
+  int update = 0;
+  int maxmsgs = 100000;
+  int nsimmax;
+  int rep, opt;
+
+  while ((opt = getopt(argc, argv, "m:b:ut:")) != -1) {
+    switch (opt) {
+    case 'm':
+      maxmsgs = atoi(optarg);
+      break;
+    case 'b':
+      baseline = optarg;
+      break;
+    case 'u':
+      update = 1;
+      break;
+    case 't':
+      tolerance = atof(optarg);
+      break;
+    default:
+      printf("usage: %s [-m maxmsgs] [-b baseline] [-u] [-t tolerance]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (rep=0; rep<REPEAT; rep++) {
+    bench_insertevent();
+    bench_timer();
+    bench_tolayer3();
+    bench_tolayer3_burst();
+    bench_checksum();
+    bench_rng();
+    for (nsimmax = 1000; nsimmax <= maxmsgs && nsimmax <= 10000000; nsimmax *= 10)
+      bench_simulation(nsimmax);
+    bench_replications(maxmsgs < 100000 ? maxmsgs : 100000);
+  }
+  print_results();
+
+  if (baseline == NULL)
+    return EXIT_SUCCESS;
+  if (update) {
+    write_baseline(baseline);
+    return EXIT_SUCCESS;
+  }
+  if (compare_baseline(baseline, tolerance) > 0)
+    return EXIT_FAILURE;
+  printf("no regressions against %s\n", baseline);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "cwnd.h"
+
+/* ******************************************************************
+   AIMD congestion window for the sender (see cwnd.h).
+**********************************************************************/
+
+#define DUPACK_THRESHOLD 3   /* duplicate ACKs that trigger a fast retransmit */
+#define MIN_SSTHRESH 2.0     /* ssthresh never drops below two packets */
+
+SIMLOCAL int congestion_control = 0;
+SIMLOCAL FILE *cwnd_log = NULL;
+
+static void cwnd_record(const struct cwnd *cw, const char *event)
+{
+  if (cwnd_log != NULL)
+    fprintf(cwnd_log, "%f,%f,%f,%s\n", current_time(), cw->cwnd, cw->ssthresh, event);
+  if (TRACE > 1)
+    printf("          CWND: %s, cwnd %f ssthresh %f\n", event, cw->cwnd, cw->ssthresh);
+}
+
+void cwnd_init(struct cwnd *cw, int maxwindow)
+{
+  cw->cwnd = 1.0;
+  cw->ssthresh = maxwindow;
+  cw->maxwindow = maxwindow;
+  cw->dupacks = 0;
+  if (cwnd_log != NULL)
+    fprintf(cwnd_log, "time,cwnd,ssthresh,event\n");
+  cwnd_record(cw, "init");
+}
+
+int cwnd_window(const struct cwnd *cw)
+{
+  int window = (int)cw->cwnd;
+
+  if (window < 1)
+    window = 1;
+  if (window > cw->maxwindow)
+    window = cw->maxwindow;
+  return window;
+}
+
+void cwnd_newack(struct cwnd *cw, int npackets)
+{
+  int i;
+
+  cw->dupacks = 0;
+  for (i=0; i<npackets; i++) {
+    if (cw->cwnd < cw->ssthresh)
+      cw->cwnd += 1.0;              /* slow start */
+    else
+      cw->cwnd += 1.0 / cw->cwnd;   /* congestion avoidance */
+  }
+  if (cw->cwnd > cw->maxwindow)
+    cw->cwnd = cw->maxwindow;
+  cwnd_record(cw, cw->cwnd < cw->ssthresh ? "slowstart" : "avoidance");
+}
+
+bool cwnd_dupack(struct cwnd *cw)
+{
+  cw->dupacks++;
+  if (cw->dupacks != DUPACK_THRESHOLD)
+    return false;
+
+  /* multiplicative decrease, continue in congestion avoidance */
+  cw->ssthresh = cw->cwnd / 2;
+  if (cw->ssthresh < MIN_SSTHRESH)
+    cw->ssthresh = MIN_SSTHRESH;
+  cw->cwnd = cw->ssthresh;
+  cwnd_record(cw, "dupack");
+  return true;
+}
+
+void cwnd_timeout(struct cwnd *cw)
+{
+  /* multiplicative decrease, restart from slow start */
+  cw->ssthresh = cw->cwnd / 2;
+  if (cw->ssthresh < MIN_SSTHRESH)
+    cw->ssthresh = MIN_SSTHRESH;
+  cw->cwnd = 1.0;
+  cw->dupacks = 0;
+  cwnd_record(cw, "timeout");
+}
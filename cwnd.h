@@ -0,0 +1,42 @@
+/* ******************************************************************
+   Sender congestion window, shared by the GBN and SR senders.
+
+   When congestion_control is non-zero the sender may only have
+   min(cwnd, WINDOWSIZE) packets outstanding.  The window follows
+   the usual AIMD rules:
+   - slow start: cwnd grows by one packet per new ACK below ssthresh
+   - congestion avoidance: cwnd grows by one packet per window of ACKs
+   - timeout: ssthresh = cwnd/2, cwnd = 1
+   - third duplicate ACK: ssthresh = cwnd/2, cwnd = ssthresh
+
+   If cwnd_log is set, every change of the window is written to it as
+   a "time,cwnd,ssthresh,event" CSV line.
+**********************************************************************/
+#include <stdio.h>
+#include <stdbool.h>
+
+extern SIMLOCAL int congestion_control;  /* 0 = fixed window, 1 = AIMD congestion window */
+extern SIMLOCAL FILE *cwnd_log;          /* cwnd time series output, NULL for none */
+
+struct cwnd {
+  double cwnd;      /* congestion window, in packets */
+  double ssthresh;  /* slow start threshold, in packets */
+  int maxwindow;    /* cwnd never grows beyond the sender's WINDOWSIZE */
+  int dupacks;      /* number of consecutive duplicate ACKs */
+};
+
+/* reset the window to one packet, ssthresh to the maximum window */
+extern void cwnd_init(struct cwnd *, int maxwindow);
+
+/* the number of packets that may currently be outstanding */
+extern int cwnd_window(const struct cwnd *);
+
+/* a new ACK acknowledged npackets packets */
+extern void cwnd_newack(struct cwnd *, int npackets);
+
+/* a duplicate ACK arrived; returns true on the third one in a row,
+   when the sender should retransmit without waiting for its timer */
+extern bool cwnd_dupack(struct cwnd *);
+
+/* the retransmission timer went off */
+extern void cwnd_timeout(struct cwnd *);
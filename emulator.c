@@ -33,112 +33,224 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Later modifications:
+   - the simulation clock and event times are double precision.
+   - messages can come from a Poisson, constant rate, on/off, saturated
+   or trace-driven source as well as the original uniform one.
+   - the protocol callbacks and emulator routines can be profiled (see
+   profile.h).
+   - a run can stop as soon as batch means estimates of its goodput,
+   latency and resends are precise enough (see batchmeans.h).
+   - B's application can read its messages at a finite rate from a
+   buffer of rcvbuf messages, whose free room B advertises to A.
+   - A and B can draw from random number streams of their own, and can
+   then run as the two logical processes of a parallel simulation (see
+   pdes.c).
+
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "simulator.h"
+#include "snapshot.h"
+#include "profile.h"
+#include "rng.h"
+#include "batchmeans.h"
 
-struct event {
-  float evtime;           /* event time */
-  int evtype;             /* event type code */
-  int eventity;           /* entity where event occurs */
-  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
-  struct event *prev;
-  struct event *next;
-};
-
-struct event *evlist = NULL;   /* the event list */
-
-/* possible events: */
-#define  TIMER_INTERRUPT 0  
-#define  FROM_LAYER5     1
-#define  FROM_LAYER3     2
+SIMLOCAL struct event *evlist = NULL;   /* the event list */
 
 #define  OFF             0
 #define  ON              1
+#define  STREAM_B        0x9e3779b9u   /* B's seed is seed ^ STREAM_B, with streams */
 
-int TRACE = 3;
+SIMLOCAL int TRACE = 3;
+SIMLOCAL int nak_recovery = 0;
+SIMLOCAL int fec_group = 0;
+SIMLOCAL int flow_control = 0;
 
 /* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
+SIMLOCAL int window_full;   /* count of the number of messages dropped due to full window */
+SIMLOCAL int window_occupancy; /* number of packets currently awaiting an ACK at A */
+SIMLOCAL int total_ACKs_received;
+SIMLOCAL int packets_resent;       /* count of the number of packets resent  */
+SIMLOCAL int new_ACKs;           /* count of the number of acks correctly received */
+SIMLOCAL int packets_received;  /* count of the packets received by receiver */
+SIMLOCAL int fec_parity_sent;   /* count of the parity packets sent by A */
+SIMLOCAL int fec_repaired;      /* count of the lost packets rebuilt from parity at B */
 
 /* statistics updated by emulator */
-static int packets_lost;  
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
-static float lambda;        /* arrival rate of messages from layer 5 */   
-static int   ntolayer3;           /* number sent into layer 3 */
-static int   nlost;               /* number lost in media */
-static int ncorrupt;              /* number corrupted by media*/
+static SIMLOCAL int packets_lost;  
+static SIMLOCAL int packets_corrupt;
+static SIMLOCAL int packets_sent;
+static SIMLOCAL int packets_timeout;
+static SIMLOCAL int messages_delivered;
+static SIMLOCAL int messages_read;
+
+static SIMLOCAL int nsim = 0;              /* number of messages from 5 to 4 so far */ 
+static SIMLOCAL struct batchmeans bm;      /* estimates kept if bm.precision > 0 */
+static SIMLOCAL int nsimmax = 0;           /* number of msgs to generate, then stop */
+static SIMLOCAL double time = 0.000;      /* simulation clock */
+static SIMLOCAL float lossprob;            /* probability that a packet is dropped  */
+static SIMLOCAL float corruptprob;   /* probability that one bit is packet is flipped */
+static SIMLOCAL int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
+static SIMLOCAL float lambda;        /* arrival rate of messages from layer 5 */   
+static SIMLOCAL int source;          /* traffic source, SOURCE_UNIFORM etc. */
+static SIMLOCAL float onmean, offmean; /* mean on and off periods of SOURCE_ONOFF */
+static SIMLOCAL double onend;        /* end of the current on period */
+static SIMLOCAL const char *tracefile; /* file of arrival times of SOURCE_TRACE */
+static SIMLOCAL double *arrivals;    /* arrival times of SOURCE_TRACE */
+static SIMLOCAL int narrivals;
+static SIMLOCAL int nextarrival;     /* next of arrivals[] to schedule */
+static SIMLOCAL float drain;         /* time B's application takes to read a message */
+static SIMLOCAL int rcvbuf;          /* messages B's application buffers */
+static SIMLOCAL int unread;          /* messages in that buffer, the first being read */
+static SIMLOCAL int   ntolayer3;           /* number sent into layer 3 */
+static SIMLOCAL int   nlost;               /* number lost in media */
+static SIMLOCAL int ncorrupt;              /* number corrupted by media*/
+static SIMLOCAL long nevents;              /* number of events simulated */
+static SIMLOCAL unsigned long long tracehash; /* hash of all events simulated so far */
+static SIMLOCAL int nevlist;               /* number of events in the event list */
+static SIMLOCAL int ninflight;             /* number of packets in the medium */
+static SIMLOCAL struct rng rng;            /* random number generator state */
+static SIMLOCAL unsigned int seed;         /* seed of the random number generator */
+static SIMLOCAL struct random_source *random_source; /* replaces rng if not NULL */
+static SIMLOCAL int streams;               /* B draws from rng_b rather than rng */
+static SIMLOCAL struct rng rng_b;          /* B's random number generator, with streams */
+static SIMLOCAL int drawer;                /* entity of the event being simulated */
+
+/* a logical process of a parallel simulation (see pdes.c) only has the
+   events of its own entity, lp: the packets it sends go to lp_sent, for
+   the other one, and the events it simulates to lp_simulated, for the
+   trace hash, instead of being freed */
+static SIMLOCAL int lp = -1;               /* A or B, -1 for a whole simulation */
+static SIMLOCAL double lp_lastarrival;     /* arrival of the last packet sent by lp */
+static SIMLOCAL struct event *lp_sent, **lp_senttail;   /* set by lp_init() */
+static SIMLOCAL struct event *lp_simulated, **lp_simulatedtail;
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
+/* isolate all random number generation in one location.  The generator in */
+/* rng.c returns the same ints in the range [0,mmm] as glibc's rand(), but  */
+/* keeps its state where a checkpoint can save it.  With streams, the      */
+/* events of B draw from a generator of their own.                          */
 /****************************************************************************/
 double jimsrand(void) 
 {
-  double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
+  double mmm = RNG_MAX;      /* largest int returned by rng_next() */
   double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
+  if (streams && drawer == B)
+    x = rng_next(&rng_b)/mmm;
+  else if (random_source != NULL) {
+    if (random_source->next == random_source->end)
+      random_source->refill(random_source);
+    x = *random_source->next++/mmm;
+  }
+  else
+    x = rng_next(&rng)/mmm;  /* x should be uniform in [0,1] */
   if (TRACE > 3)
     printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return(x);
 }  
 
+/* fold an event into tracehash, so that two runs can be compared event by
+   event by comparing their final hashes.  Fields are mixed in a 64 bit
+   word at a time (FNV-1a style multiply, with a final xorshift) to keep
+   the cost per event to a few multiplies */
+static void hashword(unsigned long long word)
+{
+  tracehash ^= word;
+  tracehash *= 1099511628211ULL;
+  tracehash ^= tracehash >> 29;
+}
+
+static void hashevent(const struct event *evptr)
+{
+  unsigned long long word;
+  const struct pkt *p = evptr->pktptr;
+  int i;
+
+  word = 0;
+  memcpy(&word, &evptr->evtime, sizeof(evptr->evtime));
+  hashword(word);
+  hashword(((unsigned long long)evptr->evtype << 32) | (unsigned)evptr->eventity);
+  if (evptr->evtype == FROM_LAYER3) {
+    hashword(((unsigned long long)(unsigned)p->seqnum << 32) | (unsigned)p->acknum);
+    hashword((unsigned)p->checksum);
+    for (i=0; i<20; i+=4) {
+      word = 0;
+      memcpy(&word, &p->payload[i], 4);
+      hashword(word);
+    }
+  }
+}
+
 /********************* EVENT HANDLINE ROUTINES *******/
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void insertevent(struct event *p)
+/* insertevent(), searching the list from the event after, which is known
+   to come before p (NULL to search the whole list) */
+static void insertevent_after(struct event *p, struct event *after)
 {
   struct event *q,*qold;
 
+  PROFILE_ENTER(PROF_INSERTEVENT);
   if (TRACE>2) {
     printf("            INSERTEVENT: time is %f\n",time);
     printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
   }
-  q = evlist;     /* q points to front of list in which p struct inserted */
-  if (q==NULL) {   /* list is empty */
-    evlist=p;
-    p->next=NULL;
-    p->prev=NULL;
-  }
-  else {
-    for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-      qold=q; 
-    if (q==NULL) {   /* end of list */
-      qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
-      p->prev=NULL;
-      p->next->prev=p;
-      evlist = p;
-    }
-    else {     /* middle of list */
-      p->next=q;
-      p->prev=q->prev;
-      q->prev->next=p;
-      q->prev=p;
-    }
+  nevlist++;
+  if (p->evtype == FROM_LAYER3)
+    ninflight++;
+  qold = after;   /* p goes between qold and q */
+  q = after != NULL ? after->next : evlist;
+  for (; q !=NULL && p->evtime > q->evtime; q=q->next)
+    qold=q;
+  p->next = q;
+  p->prev = qold;
+  if (q != NULL)
+    q->prev = p;
+  if (qold != NULL)
+    qold->next = p;
+  else             /* front of list */
+    evlist = p;
+  PROFILE_EXIT();
+}
+
+void insertevent(struct event *p)
+{
+  insertevent_after(p, NULL);
+}
+
+/* an exponentially distributed time with the given mean */
+static double exponential(double mean)
+{
+  double x;
+
+  do
+    x = jimsrand();
+  while (x >= 1.0);
+  return -mean * log(1.0 - x);
+}
+
+/* time until the next arrival of an on/off source */
+static double onoff_interval(void)
+{
+  double start = time, x;
+
+  x = exponential(lambda);
+  while (start + x > onend) {
+    /* the arrival falls after the on period: skip an off period */
+    start = onend + exponential(offmean);
+    onend = start + exponential(onmean);
+    x = exponential(lambda);
   }
+  return start + x - time;
 }
 
 void generate_next_arrival(void)
@@ -146,12 +258,39 @@ void generate_next_arrival(void)
   double x;
   struct event *evptr;
 
+  PROFILE_ENTER(PROF_ARRIVAL);
   if (TRACE>2)
     printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
  
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
-  /* having mean of lambda        */
+  switch (source) {
+  case SOURCE_POISSON:
+    x = exponential(lambda);
+    break;
+  case SOURCE_CBR:
+    x = lambda;
+    break;
+  case SOURCE_ONOFF:
+    x = onoff_interval();
+    break;
+  case SOURCE_SATURATED:
+    x = 0.0;                 /* only the first offer, see saturate() */
+    break;
+  case SOURCE_TRACE:
+    if (nextarrival >= narrivals) {
+      PROFILE_EXIT();
+      return;
+    }
+    x = arrivals[nextarrival++] - time;
+    if (x < 0.0)
+      x = 0.0;
+    break;
+  default:
+    x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
+    break;                    /* having mean of lambda        */
+  }
+  PROFILE_ENTER(PROF_MALLOC);
   evptr = malloc(sizeof(struct event));
+  PROFILE_EXIT();
   if (evptr == 0) {
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
@@ -163,6 +302,7 @@ void generate_next_arrival(void)
   else
     evptr->eventity = A;
   insertevent(evptr);
+  PROFILE_EXIT();
 } 
 
 void printevlist(void)
@@ -175,29 +315,115 @@ void printevlist(void)
   printf("--------------\n");
 }
 
+void discard_events(void)
+{
+  struct event *q;
+
+  while (evlist != NULL) {
+    q = evlist;
+    evlist = evlist->next;
+    if (q->evtype == FROM_LAYER3)
+      free(q->pktptr);
+    free(q);
+  }
+  nevlist = 0;
+  ninflight = 0;
+}
+
 void init(void)                         /* initialize the simulator */
 {
-  float sum, avg;
-  int i;
+  struct sim_params params = { 0 };
 
   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
-  scanf("%d",&nsimmax);
+  scanf("%d",&params.nsimmax);
   printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-  scanf("%f",&lossprob);
+  scanf("%f",&params.lossprob);
   printf("Enter packet corruption probability [0.0 for no corruption]:");
-  scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
+  scanf("%f",&params.corruptprob);
+  params.corruptdirection = 0;
+  if (params.lossprob != 0.0 || params.corruptprob != 0.0) {
     printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
-    scanf("%d",&corruptdirection);
+    scanf("%d",&params.corruptdirection);
   }
   printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-  scanf("%f",&lambda);
+  scanf("%f",&params.lambda);
   printf("Enter TRACE:");
-  scanf("%d",&TRACE);
+  scanf("%d",&params.trace);
+  params.seed = 9999;
+
+  init_params(&params);
+}
+
+void set_random_source(struct random_source *source)
+{
+  random_source = source;
+}
+
+/* read the arrival times of a SOURCE_TRACE run */
+static void read_arrivals(const char *file)
+{
+  FILE *fp;
+  char line[256];
+  double t;
+  int size = 0;
+
+  free(arrivals);
+  arrivals = NULL;
+  narrivals = 0;
+  fp = file != NULL ? fopen(file, "r") : NULL;
+  if (fp == NULL) {
+    printf("unable to open arrival trace %s\n", file != NULL ? file : "(none)");
+    exit(EXIT_FAILURE);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#' || sscanf(line, "%lf", &t) != 1)
+      continue;
+    if (narrivals == size) {
+      size = size > 0 ? 2 * size : 1024;
+      arrivals = realloc(arrivals, size * sizeof(double));
+      if (arrivals == NULL) {
+        printf("memory allocation for arrival trace failed.");
+        exit(EXIT_FAILURE);
+      }
+    }
+    arrivals[narrivals++] = t;
+  }
+  fclose(fp);
+}
 
+void init_params(const struct sim_params *params)
+{
+  float sum, avg;
+  int i;
 
-  srand(9999);              /* init random number generator */
+  nsimmax = params->nsimmax;
+  lossprob = params->lossprob;
+  corruptprob = params->corruptprob;
+  corruptdirection = params->corruptdirection;
+  lambda = params->lambda;
+  TRACE = params->trace;
+  nak_recovery = params->nak;
+  fec_group = params->fec;
+  drain = params->drain;
+  rcvbuf = params->rcvbuf > 0 ? params->rcvbuf : 1;
+  flow_control = drain > 0.0;
+  unread = 0;
+  batchmeans_init(&bm, params->warmup, params->precision);
+  source = params->source;
+  onmean = params->on;
+  offmean = params->off;
+  tracefile = params->tracefile;
+  nextarrival = 0;
+  if (source == SOURCE_TRACE)
+    read_arrivals(tracefile);
+
+  seed = params->seed;
+  rng_seed(&rng, seed);     /* init random number generator */
+  streams = params->streams;
+  rng_seed(&rng_b, seed ^ STREAM_B);
+  drawer = A;
+  lp = -1;
   sum = 0.0;                /* test random number generator for students */
   for (i=0; i<1000; i++)
     sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
@@ -209,26 +435,73 @@ void init(void)                         /* initialize the simulator */
     exit(EXIT_FAILURE);
   }
 
+  /* discard events left over from a previous run */
+  discard_events();
+
   /* initialise statistics */
   window_full = 0;
   total_ACKs_received = 0;
   packets_resent = 0;
   new_ACKs = 0;
   packets_received = 0;
+  fec_parity_sent = 0;
+  fec_repaired = 0;
   packets_lost = 0;  
   packets_corrupt = 0;
   packets_sent = 0;
   packets_timeout = 0;
   messages_delivered = 0;
+  messages_read = 0;
 
   ntolayer3 = 0;
   nlost = 0;
   ncorrupt = 0;
+  nevents = 0;
+  nevlist = 0;
+  ninflight = 0;
+  window_occupancy = 0;
+  tracehash = 14695981039346656037ULL;
+  nsim = 0;
 
   time=0.0;                    /* initialize time to 0.0 */
+  onend = 0.0;
+  if (source == SOURCE_ONOFF)
+    onend = exponential(onmean);  /* start with an on period */
   generate_next_arrival();     /* initialize event list */
 }
 
+void update_params(const struct sim_params *params)
+{
+  nsimmax = params->nsimmax;
+  lossprob = params->lossprob;
+  corruptprob = params->corruptprob;
+  corruptdirection = params->corruptdirection;
+  lambda = params->lambda;
+  TRACE = params->trace;
+}
+
+void get_params(struct sim_params *params)
+{
+  params->nsimmax = nsimmax;
+  params->lossprob = lossprob;
+  params->corruptprob = corruptprob;
+  params->corruptdirection = corruptdirection;
+  params->lambda = lambda;
+  params->trace = TRACE;
+  params->seed = seed;
+  params->source = source;
+  params->on = onmean;
+  params->off = offmean;
+  params->tracefile = tracefile;
+  params->nak = nak_recovery;
+  params->fec = fec_group;
+  params->warmup = bm.warmup;
+  params->precision = bm.precision;
+  params->drain = drain;
+  params->rcvbuf = rcvbuf;
+  params->streams = streams;
+}
+
 /********************** Student-callable ROUTINES ***********************/
 
 /* called by students routine to cancel a previously-started timer */
@@ -237,6 +510,7 @@ void stoptimer(int AorB)
 {
   struct event *q;
 
+  PROFILE_ENTER(PROF_STOPTIMER);
   if (TRACE>1)
     printf("          STOP TIMER: stopping timer at %f\n",time);
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
@@ -255,10 +529,13 @@ void stoptimer(int AorB)
         q->next->prev = q->prev;
         q->prev->next =  q->next;
       }
+      nevlist--;
       free(q);
+      PROFILE_EXIT();
       return;
     }
   printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  PROFILE_EXIT();
 }
 
 
@@ -269,6 +546,7 @@ void starttimer(int AorB, double increment)
   struct event *q;
   struct event *evptr;
 
+  PROFILE_ENTER(PROF_STARTTIMER);
   if (TRACE>1)
     printf("          START TIMER: starting timer at %f\n",time);
   /* be nice: check to see if timer is already started, if so, then  warn */
@@ -276,11 +554,14 @@ void starttimer(int AorB, double increment)
   for (q=evlist; q!=NULL ; q = q->next)  
     if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
       printf("Warning: attempt to start a timer that is already started\n");
+      PROFILE_EXIT();
       return;
     }
  
   /* create future event for when timer goes off */
+  PROFILE_ENTER(PROF_MALLOC);
   evptr = malloc(sizeof(struct event));
+  PROFILE_EXIT();
   if (evptr == 0) {
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
@@ -291,40 +572,68 @@ void starttimer(int AorB, double increment)
  
   evptr->eventity = AorB;
   insertevent(evptr);
+  PROFILE_EXIT();
 } 
 
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+double current_time(void)
 {
-  struct pkt *mypktptr;
-  struct event *evptr,*q;
-  float lastime, x;
-  int i;
-
-  ntolayer3++;
+  return time;
+}
 
-  /* simulate losses: */
+/************************** TOLAYER3 ***************/
+/* does the medium lose a packet sent by AorB? */
+static int packet_lost(int AorB)
+{
   if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
     nlost++;
     if (TRACE>0)    
       printf("          TOLAYER3: packet being lost\n");
-    return;
+    return 1;
   }  
+  return 0;
+}
+
+/* the time of the last arrival of a packet at entity (the current time if
+   there is none) and its event, NULL if there is none */
+static double last_arrival(int entity, struct event **last)
+{
+  struct event *q;
+  double lastime = time;
+
+  *last = NULL;
+  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
+  for (q=evlist; q!=NULL ; q = q->next) 
+    if ( (q->evtype==FROM_LAYER3  && q->eventity==entity) ) {
+      lastime = q->evtime;
+      *last = q;
+    }
+  return lastime;
+}
+
+/* the arrival event at the other side of a packet sent by AorB, possibly
+   corrupted, after the arrival at lastime */
+static struct event *packet_arrival(int AorB, const struct pkt *packet, double lastime)
+{
+  struct pkt *mypktptr;
+  struct event *evptr;
+  double x;
+  int i;
 
   /* make a copy of the packet student just gave me since he/she may decide */
   /* to do something with the packet after we return back to him/her */ 
+  PROFILE_ENTER(PROF_MALLOC);
   mypktptr = malloc(sizeof(struct pkt));
+  PROFILE_EXIT();
   if (mypktptr == 0) {
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
   }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
+  mypktptr->seqnum = packet->seqnum;
+  mypktptr->acknum = packet->acknum;
+  mypktptr->checksum = packet->checksum;
   for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
+    mypktptr->payload[i] = packet->payload[i];
   if (TRACE>2)  {
     printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
            mypktptr->acknum,  mypktptr->checksum);
@@ -334,7 +643,9 @@ void tolayer3(int AorB, struct pkt packet)
   }
 
   /* create future event for arrival of packet at the other side */
+  PROFILE_ENTER(PROF_MALLOC);
   evptr = malloc(sizeof(struct event));
+  PROFILE_EXIT();
   if (evptr == 0) {
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
@@ -346,14 +657,7 @@ void tolayer3(int AorB, struct pkt packet)
      medium can not reorder, so make sure packet arrives between 1 and 10
      time units after the latest arrival time of packets
      currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
   evptr->evtime =  lastime + 1 + 9*jimsrand();
- 
-
 
   /* simulate corruption: */
   if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
@@ -370,12 +674,80 @@ void tolayer3(int AorB, struct pkt packet)
 
   if (TRACE>2)  
     printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
+  return evptr;
+}
+
+void tolayer3(int AorB, struct pkt packet)
+/* A or B is sending to network  */
+{
+  tolayer3_burst(AorB, &packet, 1);
+}
+
+/* the packets are sent one after the other, each with the random numbers
+   of its own tolayer3() call; the medium is searched only once for the
+   last packet in flight to the other side, and every arrival is inserted
+   into the event list after the previous one */
+void tolayer3_burst(int AorB, const struct pkt *packets, int n)
+{
+  struct event *evptr, *last = NULL;
+  double lastime = 0.0;
+  int i, scanned = 0;
+
+  PROFILE_ENTER(PROF_TOLAYER3);
+  for (i=0; i<n; i++) {
+    ntolayer3++;
+
+    /* simulate losses: */
+    if (packet_lost(AorB))
+      continue;
+
+    /* a logical process knows its own packets in the medium */
+    if (lp >= 0) {
+      evptr = packet_arrival(AorB, &packets[i], lp_lastarrival > time ? lp_lastarrival : time);
+      lp_lastarrival = evptr->evtime;
+      evptr->next = NULL;
+      *lp_senttail = evptr;
+      lp_senttail = &evptr->next;
+      continue;
+    }
+
+    if (!scanned) {
+      lastime = last_arrival((AorB+1) % 2, &last);
+      scanned = 1;
+    }
+    evptr = packet_arrival(AorB, &packets[i], lastime);
+
+    /* every event up to the last arrival comes before this one */
+    insertevent_after(evptr, last);
+    last = evptr;
+    lastime = evptr->evtime;
+  }
+  PROFILE_EXIT();
 } 
 
+/* B's application will have read its oldest message drain time units from now */
+static void schedule_read(void)
+{
+  struct event *evptr;
+
+  PROFILE_ENTER(PROF_MALLOC);
+  evptr = malloc(sizeof(struct event));
+  PROFILE_EXIT();
+  if (evptr == NULL) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtime = time + drain;
+  evptr->evtype = LAYER5_READ;
+  evptr->eventity = B;
+  evptr->pktptr = NULL;
+  insertevent(evptr);
+}
+
 void tolayer5(int AorB, char datasent[20])
 {
   int i;  
+  PROFILE_ENTER(PROF_TOLAYER5);
   if (TRACE>2) {
     printf("          TOLAYER5: data received by application at ");
     if (AorB == A) 
@@ -387,27 +759,76 @@ void tolayer5(int AorB, char datasent[20])
     printf("\n");
   }
   messages_delivered++;
+  if (AorB == B && bm.precision > 0.0)
+    batchmeans_deliver(&bm, time, packets_resent);
+  if (AorB == B && flow_control && unread++ == 0)
+    schedule_read();
+  PROFILE_EXIT();
+}
+
+int tolayer5_room(int AorB)
+{
+  if (AorB == B && flow_control)
+    return unread < rcvbuf ? rcvbuf - unread : 0;
+  return INT_MAX;
+}
+
+/* B's application has read a message: start on the next one */
+static void read_message(void)
+{
+  if (TRACE>2)
+    printf("          LAYER5_READ: B's application read a message, %d left\n", unread - 1);
+  messages_read++;
+  if (--unread > 0)
+    schedule_read();
+}
+
+/* SOURCE_SATURATED: give A messages until its window refuses one, which
+   is kept for the next offer rather than counted as dropped */
+static void saturate(void)
+{
+  struct msg msg2give;
+  int i, full;
+
+  while (nsim < nsimmax) {
+    for (i=0; i<20; i++)
+      msg2give.data[i] = 97 + nsim % 26;
+    full = window_full;
+    PROFILE_ENTER(PROF_A_OUTPUT);
+    A_output(msg2give);
+    PROFILE_EXIT();
+    if (window_full != full) {
+      window_full = full;
+      return;
+    }
+    if (bm.precision > 0.0)
+      batchmeans_accept(&bm, time);
+    nsim++;
+  }
 }
 
-int main(void)
+/* simulate at most maxevents events (all if < 0) that occur no later than endtime */
+static long run(long maxevents, double endtime)
 {
   struct event *eventptr;
   struct msg  msg2give;
   struct pkt  pkt2give;
-   
-  int i,j;
-  
-  init();
-  A_init();
-  B_init();
-   
-  while (1) {
+  long n;
+  int i,j,full;
+
+  for (n = 0; maxevents < 0 || n < maxevents; n++) {
     eventptr = evlist;            /* get next event to simulate */
-    if (eventptr==NULL)
-      goto terminate;
+    if (eventptr==NULL || eventptr->evtime > endtime)
+      break;
     evlist = evlist->next;        /* remove this event from event list */
     if (evlist!=NULL)
       evlist->prev=NULL;
+    nevents++;
+    nevlist--;
+    if (eventptr->evtype == FROM_LAYER3)
+      ninflight--;
+    if (lp < 0)
+      hashevent(eventptr);
     if (TRACE>=2) {
       printf("\nEVENT time: %f,",eventptr->evtime);
       printf("  type: %d",eventptr->evtype);
@@ -415,12 +836,17 @@ int main(void)
         printf(", timerinterrupt  ");
       else if (eventptr->evtype==1)
         printf(", fromlayer5 ");
+      else if (eventptr->evtype==LAYER5_READ)
+        printf(", layer5read ");
       else
         printf(", fromlayer3 ");
       printf(" entity: %d\n",eventptr->eventity);
     }
     time = eventptr->evtime;        /* update time to next event time */
-    if (eventptr->evtype == FROM_LAYER5 ) {
+    drawer = eventptr->eventity;
+    if (eventptr->evtype == FROM_LAYER5 && source == SOURCE_SATURATED)
+      saturate();
+    else if (eventptr->evtype == FROM_LAYER5 ) {
       if (nsim < nsimmax) {
         generate_next_arrival();   /* set up future arrival */
         /* fill in msg to give with string of same letter */    
@@ -434,10 +860,19 @@ int main(void)
           printf("\n");
         }
         nsim++;
-        if (eventptr->eventity == A) 
+        if (eventptr->eventity == A) {
+          full = window_full;
+          PROFILE_ENTER(PROF_A_OUTPUT);
           A_output(msg2give);  
-        else
+          PROFILE_EXIT();
+          if (bm.precision > 0.0 && window_full == full)
+            batchmeans_accept(&bm, time);
+        }
+        else {
+          PROFILE_ENTER(PROF_B_OUTPUT);
           B_output(msg2give);  
+          PROFILE_EXIT();
+        }
       }
       else if (TRACE > 2)
           printf("          FROM_LAYER5: no more messages to send: \n");
@@ -448,25 +883,176 @@ int main(void)
       pkt2give.checksum = eventptr->pktptr->checksum;
       for (i=0; i<20; i++)  
         pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
+	    if (eventptr->eventity ==A) {    /* deliver packet by calling */
+        PROFILE_ENTER(PROF_A_INPUT);
         A_input(pkt2give);            /* appropriate entity */
-      else
+      }
+      else {
+        PROFILE_ENTER(PROF_B_INPUT);
         B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
+      }
+      PROFILE_EXIT();
     }
     else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
+      if (eventptr->eventity == A) {
+        PROFILE_ENTER(PROF_A_TIMER);
         A_timerinterrupt();
-      else
+      }
+      else {
+        PROFILE_ENTER(PROF_B_TIMER);
         B_timerinterrupt();
+      }
+      PROFILE_EXIT();
+    }
+    else if (eventptr->evtype == LAYER5_READ) {
+      PROFILE_ENTER(PROF_LAYER5_READ);
+      read_message();
+      PROFILE_EXIT();
     }
     else  {
       printf("INTERNAL PANIC: unknown event type \n");
     }
-    free(eventptr);
+    /* an ACK or timeout at A may have opened its window */
+    if (source == SOURCE_SATURATED && eventptr->eventity == A && eventptr->evtype != FROM_LAYER5)
+      saturate();
+    if (lp >= 0) {
+      eventptr->next = NULL;
+      *lp_simulatedtail = eventptr;
+      lp_simulatedtail = &eventptr->next;
+    }
+    else {
+      if (eventptr->evtype == FROM_LAYER3)
+        free(eventptr->pktptr);        /* free the memory for packet */
+      free(eventptr);
+    }
+
+    if (nevents >= snapshot_next_event || time >= snapshot_next_time)
+      snapshot_take();
+
+    /* the estimates are precise enough: the run ends here */
+    if (bm.done) {
+      if (TRACE>0)
+        printf("          MAINLOOP: estimates reached the precision, stopping\n");
+      discard_events();
+      n++;
+      break;
+    }
+  }
+  return n;
+}
+
+long run_simulation(long maxevents)
+{
+  return run(maxevents, DBL_MAX);
+}
+
+long run_until(double endtime)
+{
+  return run(-1, endtime);
+}
+
+/****************** LOGICAL PROCESSES ********************/
+/*  One entity of a parallel simulation, A or B, simulated */
+/*  by the calling thread (see pdes.c)                     */
+/**********************************************************/
+
+void lp_init(const struct sim_params *params, int entity)
+{
+  init_params(params);
+  if (entity == B)            /* the first arrival is A's */
+    discard_events();
+  lp = entity;
+  drawer = entity;
+  lp_lastarrival = 0.0;
+  lp_sent = lp_simulated = NULL;
+  lp_senttail = &lp_sent;
+  lp_simulatedtail = &lp_simulated;
+}
+
+double lp_next(void)
+{
+  return evlist != NULL ? evlist->evtime : DBL_MAX;
+}
+
+struct event *lp_take_sent(void)
+{
+  struct event *p = lp_sent;
+
+  lp_sent = NULL;
+  lp_senttail = &lp_sent;
+  return p;
+}
+
+struct event *lp_take_simulated(void)
+{
+  struct event *p = lp_simulated;
+
+  lp_simulated = NULL;
+  lp_simulatedtail = &lp_simulated;
+  return p;
+}
+
+void lp_receive(struct event *p)
+{
+  struct event *next, *after = NULL;
+
+  /* in increasing time order, so each one goes after the one before */
+  for (; p != NULL; p = next) {
+    next = p->next;
+    insertevent_after(p, after);
+    after = p;
   }
+}
+
+void lp_hash(struct event *a, struct event *b)
+{
+  struct event *p;
+
+  while (a != NULL || b != NULL) {
+    if (b == NULL || (a != NULL && a->evtime <= b->evtime)) {
+      p = a;
+      a = a->next;
+    }
+    else {
+      p = b;
+      b = b->next;
+    }
+    hashevent(p);
+    if (p->evtype == FROM_LAYER3)
+      free(p->pktptr);
+    free(p);
+  }
+}
+
+void get_statistics(struct sim_stats *stats)
+{
+  stats->time = time;
+  stats->nevents = nevents;
+  stats->tracehash = tracehash;
+  stats->nsim = nsim;
+  stats->window_full = window_full;
+  stats->total_ACKs_received = total_ACKs_received;
+  stats->packets_resent = packets_resent;
+  stats->new_ACKs = new_ACKs;
+  stats->packets_received = packets_received;
+  stats->messages_delivered = messages_delivered;
+  stats->ntolayer3 = ntolayer3;
+  stats->nlost = nlost;
+  stats->ncorrupt = ncorrupt;
+  stats->nevlist = nevlist;
+  stats->ninflight = ninflight;
+  stats->window_occupancy = window_occupancy;
+  stats->fec_parity_sent = fec_parity_sent;
+  stats->fec_repaired = fec_repaired;
+  stats->nbatches = bm.nbatches;
+  batchmeans_estimates(&bm, stats->estimate, stats->halfwidth);
+  stats->messages_read = messages_read;
+}
+
+void print_statistics(void)
+{
+  double mean[BM_NESTIMATES], halfwidth[BM_NESTIMATES];
 
- terminate:
   printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
   printf("number of messages dropped due to full window:  %d \n", window_full);
   printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
@@ -474,5 +1060,317 @@ int main(void)
   printf("number of packet resends by A:  %d \n", packets_resent);
   printf("number of correct packets received at B:  %d \n", packets_received);
   printf("number of messages delivered to application:  %d \n", messages_delivered);
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+  if (fec_group > 0) {
+    printf("number of parity packets sent by A:  %d (%.1f%% of the packets sent)\n", fec_parity_sent,
+           ntolayer3 > 0 ? 100.0 * fec_parity_sent / ntolayer3 : 0.0);
+    printf("number of lost packets repaired by parity at B:  %d \n", fec_repaired);
+  }
+  if (flow_control)
+    printf("number of messages read by B's application (one per %f time units, buffer of %d):  %d \n",
+           drain, rcvbuf, messages_read);
+  if (bm.precision > 0.0) {
+    batchmeans_estimates(&bm, mean, halfwidth);
+    printf("batch means after warm-up %f: %d batches of %d messages, %s\n", bm.warmup,
+           bm.nbatches, bm.batchsize, bm.done ? "precision reached" : "precision not reached");
+    printf("goodput (msgs/time):  %f +- %f \n", mean[BM_GOODPUT], halfwidth[BM_GOODPUT]);
+    printf("latency (time):  %f +- %f \n", mean[BM_LATENCY], halfwidth[BM_LATENCY]);
+    printf("resends per message delivered:  %f +- %f \n", mean[BM_RESENDS], halfwidth[BM_RESENDS]);
+  }
+}
+
+/********************** CHECKPOINTS ***********************/
+/*  A checkpoint holds the complete simulation state: the */
+/*  event list, clock, random number generator, counters  */
+/*  and the protocol state saved by protocol_save_state() */
+/**********************************************************/
+
+#define CHECKPOINT_MAGIC   0x54504b43    /* "CKPT" */
+#define CHECKPOINT_VERSION 7
+
+/* every emulator variable, apart from the event list */
+struct emulator_state {
+  int trace;
+  int window_full, window_occupancy, total_ACKs_received, packets_resent;
+  int new_ACKs, packets_received;
+  int packets_lost, packets_corrupt, packets_sent, packets_timeout, messages_delivered;
+  int nsim, nsimmax;
+  double time;
+  float lossprob, corruptprob;
+  int corruptdirection;
+  float lambda;
+  int ntolayer3, nlost, ncorrupt;
+  long nevents;
+  unsigned long long tracehash;
+  int nevlist, ninflight;
+  struct rng rng;
+  unsigned int seed;
+  int source;
+  float onmean, offmean;
+  double onend;
+  int nak_recovery;
+  int fec_group, fec_parity_sent, fec_repaired;
+  struct batchmeans bm;
+  float drain;
+  int rcvbuf, unread, messages_read;
+  int streams;
+  struct rng rng_b;
+};
+
+/* an event list entry, with its packet (if any) */
+struct checkpoint_event {
+  double evtime;
+  int evtype;
+  int eventity;
+  struct pkt pkt;
+};
+
+struct checkpoint {
+  struct emulator_state emu;
+  int nevents;                        /* entries in events[] */
+  struct checkpoint_event *events;
+  size_t protocol_size;
+  unsigned char *protocol;            /* protocol_save_state() data */
+  int narrivals;                      /* entries in arrivals[] */
+  double *arrivals;                   /* SOURCE_TRACE arrivals still to come */
+};
+
+static void *checkpoint_alloc(size_t size)
+{
+  void *p = malloc(size > 0 ? size : 1);
+
+  if (p == NULL) {
+    printf("memory allocation for checkpoint failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+struct checkpoint *checkpoint_save(void)
+{
+  struct checkpoint *cp;
+  struct emulator_state *e;
+  struct event *q;
+  int i;
+
+  cp = checkpoint_alloc(sizeof(struct checkpoint));
+  e = &cp->emu;
+  memset(e, 0, sizeof(*e));
+  e->trace = TRACE;
+  e->window_full = window_full;
+  e->window_occupancy = window_occupancy;
+  e->total_ACKs_received = total_ACKs_received;
+  e->packets_resent = packets_resent;
+  e->new_ACKs = new_ACKs;
+  e->packets_received = packets_received;
+  e->packets_lost = packets_lost;
+  e->packets_corrupt = packets_corrupt;
+  e->packets_sent = packets_sent;
+  e->packets_timeout = packets_timeout;
+  e->messages_delivered = messages_delivered;
+  e->nsim = nsim;
+  e->nsimmax = nsimmax;
+  e->time = time;
+  e->lossprob = lossprob;
+  e->corruptprob = corruptprob;
+  e->corruptdirection = corruptdirection;
+  e->lambda = lambda;
+  e->ntolayer3 = ntolayer3;
+  e->nlost = nlost;
+  e->ncorrupt = ncorrupt;
+  e->nevents = nevents;
+  e->tracehash = tracehash;
+  e->nevlist = nevlist;
+  e->ninflight = ninflight;
+  e->rng = rng;
+  e->seed = seed;
+  e->source = source;
+  e->onmean = onmean;
+  e->offmean = offmean;
+  e->onend = onend;
+  e->nak_recovery = nak_recovery;
+  e->fec_group = fec_group;
+  e->fec_parity_sent = fec_parity_sent;
+  e->fec_repaired = fec_repaired;
+  e->bm = bm;
+  e->drain = drain;
+  e->rcvbuf = rcvbuf;
+  e->unread = unread;
+  e->messages_read = messages_read;
+  e->streams = streams;
+  e->rng_b = rng_b;
+
+  cp->nevents = 0;
+  for (q=evlist; q!=NULL; q=q->next)
+    cp->nevents++;
+  cp->events = checkpoint_alloc(cp->nevents * sizeof(struct checkpoint_event));
+  for (q=evlist, i=0; q!=NULL; q=q->next, i++) {
+    memset(&cp->events[i], 0, sizeof(struct checkpoint_event));
+    cp->events[i].evtime = q->evtime;
+    cp->events[i].evtype = q->evtype;
+    cp->events[i].eventity = q->eventity;
+    if (q->evtype == FROM_LAYER3)
+      cp->events[i].pkt = *q->pktptr;
+  }
+
+  cp->protocol_size = protocol_state_size();
+  cp->protocol = checkpoint_alloc(cp->protocol_size);
+  protocol_save_state(cp->protocol);
+
+  cp->narrivals = narrivals - nextarrival;
+  cp->arrivals = checkpoint_alloc(cp->narrivals * sizeof(double));
+  if (cp->narrivals > 0)
+    memcpy(cp->arrivals, arrivals + nextarrival, cp->narrivals * sizeof(double));
+  return cp;
+}
+
+void checkpoint_restore(const struct checkpoint *cp)
+{
+  const struct emulator_state *e = &cp->emu;
+  struct event *evptr, *last;
+  int i;
+
+  /* discard the current event list */
+  discard_events();
+
+  TRACE = e->trace;
+  window_full = e->window_full;
+  window_occupancy = e->window_occupancy;
+  total_ACKs_received = e->total_ACKs_received;
+  packets_resent = e->packets_resent;
+  new_ACKs = e->new_ACKs;
+  packets_received = e->packets_received;
+  packets_lost = e->packets_lost;
+  packets_corrupt = e->packets_corrupt;
+  packets_sent = e->packets_sent;
+  packets_timeout = e->packets_timeout;
+  messages_delivered = e->messages_delivered;
+  nsim = e->nsim;
+  nsimmax = e->nsimmax;
+  time = e->time;
+  lossprob = e->lossprob;
+  corruptprob = e->corruptprob;
+  corruptdirection = e->corruptdirection;
+  lambda = e->lambda;
+  ntolayer3 = e->ntolayer3;
+  nlost = e->nlost;
+  ncorrupt = e->ncorrupt;
+  nevents = e->nevents;
+  tracehash = e->tracehash;
+  nevlist = e->nevlist;
+  ninflight = e->ninflight;
+  rng = e->rng;
+  seed = e->seed;
+  source = e->source;
+  onmean = e->onmean;
+  offmean = e->offmean;
+  onend = e->onend;
+  nak_recovery = e->nak_recovery;
+  fec_group = e->fec_group;
+  fec_parity_sent = e->fec_parity_sent;
+  fec_repaired = e->fec_repaired;
+  bm = e->bm;
+  drain = e->drain;
+  rcvbuf = e->rcvbuf;
+  unread = e->unread;
+  messages_read = e->messages_read;
+  streams = e->streams;
+  rng_b = e->rng_b;
+  flow_control = drain > 0.0;
+
+  free(arrivals);
+  arrivals = checkpoint_alloc(cp->narrivals * sizeof(double));
+  if (cp->narrivals > 0)
+    memcpy(arrivals, cp->arrivals, cp->narrivals * sizeof(double));
+  narrivals = cp->narrivals;
+  nextarrival = 0;
+
+  /* rebuild the event list in the saved order */
+  last = NULL;
+  for (i=0; i<cp->nevents; i++) {
+    evptr = checkpoint_alloc(sizeof(struct event));
+    evptr->evtime = cp->events[i].evtime;
+    evptr->evtype = cp->events[i].evtype;
+    evptr->eventity = cp->events[i].eventity;
+    evptr->pktptr = NULL;
+    if (evptr->evtype == FROM_LAYER3) {
+      evptr->pktptr = checkpoint_alloc(sizeof(struct pkt));
+      *evptr->pktptr = cp->events[i].pkt;
+    }
+    evptr->prev = last;
+    evptr->next = NULL;
+    if (last == NULL)
+      evlist = evptr;
+    else
+      last->next = evptr;
+    last = evptr;
+  }
+
+  protocol_restore_state(cp->protocol);
+}
+
+void checkpoint_free(struct checkpoint *cp)
+{
+  free(cp->events);
+  free(cp->protocol);
+  free(cp->arrivals);
+  free(cp);
+}
+
+/* file format: magic, version, the sizes of the emulator and protocol
+   state (which must match the reading program), the emulator state, the
+   number of events, the events, the protocol state, and the number of
+   trace arrivals to come and their times */
+int checkpoint_write(const struct checkpoint *cp, FILE *fp)
+{
+  unsigned int header[4];
+
+  header[0] = CHECKPOINT_MAGIC;
+  header[1] = CHECKPOINT_VERSION;
+  header[2] = sizeof(struct emulator_state);
+  header[3] = cp->protocol_size;
+  if (fwrite(header, sizeof(header), 1, fp) != 1 ||
+      fwrite(&cp->emu, sizeof(cp->emu), 1, fp) != 1 ||
+      fwrite(&cp->nevents, sizeof(cp->nevents), 1, fp) != 1 ||
+      fwrite(cp->events, sizeof(struct checkpoint_event), cp->nevents, fp) != (size_t)cp->nevents ||
+      fwrite(cp->protocol, cp->protocol_size, 1, fp) != 1 ||
+      fwrite(&cp->narrivals, sizeof(cp->narrivals), 1, fp) != 1 ||
+      fwrite(cp->arrivals, sizeof(double), cp->narrivals, fp) != (size_t)cp->narrivals)
+    return -1;
+  return 0;
+}
+
+struct checkpoint *checkpoint_read(FILE *fp)
+{
+  struct checkpoint *cp;
+  unsigned int header[4];
+
+  if (fread(header, sizeof(header), 1, fp) != 1 ||
+      header[0] != CHECKPOINT_MAGIC || header[1] != CHECKPOINT_VERSION ||
+      header[2] != sizeof(struct emulator_state) || header[3] != protocol_state_size())
+    return NULL;
+
+  cp = checkpoint_alloc(sizeof(struct checkpoint));
+  cp->events = NULL;
+  cp->protocol = NULL;
+  cp->arrivals = NULL;
+  if (fread(&cp->emu, sizeof(cp->emu), 1, fp) != 1 ||
+      fread(&cp->nevents, sizeof(cp->nevents), 1, fp) != 1 || cp->nevents < 0) {
+    free(cp);
+    return NULL;
+  }
+  cp->events = checkpoint_alloc(cp->nevents * sizeof(struct checkpoint_event));
+  cp->protocol_size = header[3];
+  cp->protocol = checkpoint_alloc(cp->protocol_size);
+  if ((cp->nevents > 0 && fread(cp->events, sizeof(struct checkpoint_event), cp->nevents, fp) != (size_t)cp->nevents) ||
+      fread(cp->protocol, cp->protocol_size, 1, fp) != 1 ||
+      fread(&cp->narrivals, sizeof(cp->narrivals), 1, fp) != 1 || cp->narrivals < 0) {
+    checkpoint_free(cp);
+    return NULL;
+  }
+  cp->arrivals = checkpoint_alloc(cp->narrivals * sizeof(double));
+  if (cp->narrivals > 0 && fread(cp->arrivals, sizeof(double), cp->narrivals, fp) != (size_t)cp->narrivals) {
+    checkpoint_free(cp);
+    return NULL;
+  }
+  return cp;
+}
@@ -1,11 +1,25 @@
-extern int TRACE;
+/* every variable of the emulator and the protocols is per thread, so that
+   independent simulations, and the A and B of a parallel one (see pdes.c),
+   can run in parallel threads; build with -DSIMLOCAL= for plain globals */
+#ifndef SIMLOCAL
+#define SIMLOCAL _Thread_local
+#endif
+
+extern SIMLOCAL int TRACE;
+extern SIMLOCAL int nak_recovery;  /* SR: B sends NAKs for the gaps it sees */
+extern SIMLOCAL int fec_group;     /* GBN: a parity packet follows every fec_group packets, 0 for none */
+extern SIMLOCAL int flow_control;  /* B's application reads slowly: B advertises its free
+                                      buffer in its ACKs and A keeps within it */
 
 /* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;       /* count of the number of packets resent  */
-extern int new_ACKs;      /* count of the number of acks correctly received */
-extern int packets_received;  /* count of the packets received by receiver */
-extern int window_full; /* count of the number of messages dropped due to full window */
+extern SIMLOCAL int total_ACKs_received;
+extern SIMLOCAL int packets_resent;       /* count of the number of packets resent  */
+extern SIMLOCAL int new_ACKs;      /* count of the number of acks correctly received */
+extern SIMLOCAL int packets_received;  /* count of the packets received by receiver */
+extern SIMLOCAL int window_full; /* count of the number of messages dropped due to full window */
+extern SIMLOCAL int window_occupancy; /* number of packets currently awaiting an ACK at A */
+extern SIMLOCAL int fec_parity_sent;  /* count of the parity packets sent by A */
+extern SIMLOCAL int fec_repaired;     /* count of the lost packets rebuilt from parity at B */
 
 #define   A    0
 #define   B    1
@@ -30,11 +44,23 @@ struct pkt {
 /* send to A or B (int), packet to send */
 extern void tolayer3(int, struct pkt);  
 
+/* send to A or B (int), packets to send (const struct pkt *), number of
+   packets (int): the same as a tolayer3 call for each packet in turn,
+   at a lower cost */
+extern void tolayer3_burst(int, const struct pkt *, int);
+
 /* deliver to A or B (int), data to deliver */
 extern void tolayer5(int, char[20]); 
 
+/* the number of messages the application at A or B (int) still has room
+   for; only B's is limited, with flow_control */
+extern int tolayer5_room(int);
+
 /* start timer at A or B (int), increment */
 extern void starttimer(int, double);       
 
 /* stop timer at A or B (int) */
 extern void stoptimer(int);               
+
+/* current simulation time */
+extern double current_time(void);
@@ -1,8 +1,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "cwnd.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -20,6 +22,18 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - added optional AIMD congestion window (see cwnd.h)
+   - added optional forward error correction (fec_group): A follows
+   every block of fec_group new packets with a parity packet, the XOR
+   of their payloads, and B rebuilds the packet it expects from the
+   parity when it is the only one of its block missing.  B then also
+   keeps the packets that arrive after a gap, and delivers them once
+   the gap is filled.
+   - added flow control (flow_control): B delivers a packet only if its
+   application has room for it, and advertises that room in payload[1]
+   of its ACKs.  A keeps no more packets awaiting an ACK than the last
+   advertised room, but always at least one, so that with the room at
+   0 its timer keeps probing B until the application has read a message.
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
@@ -27,6 +41,27 @@
                           MUST BE SET TO 6 when submitting assignment */
 #define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define PARITY (-2)     /* seqnum of a parity packet, whose acknum is the first packet of its block */
+
+/* the sequence space in use: B keeps packets ahead of the one it expects
+   with FEC, so it must tell them from old ones, as in Selective Repeat */
+static int seqspace(void)
+{
+  if (fec_group > 0)
+    return 2 * WINDOWSIZE;
+  return SEQSPACE;
+}
+
+/* the packets covered by a parity packet; a block must fit in the window
+   for B to still hold its other packets when the parity arrives */
+static int fec_blocksize(void)
+{
+  if (fec_group < WINDOWSIZE)
+    return fec_group;
+  return WINDOWSIZE;
+}
+
+const char protocol_name[] = "gbn";
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
@@ -58,10 +93,74 @@ bool IsCorrupted(struct pkt packet)
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+static SIMLOCAL struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+static SIMLOCAL int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
+static SIMLOCAL int windowcount;                /* the number of packets currently awaiting an ACK */
+static SIMLOCAL int A_nextseqnum;               /* the next sequence number to be used by the sender */
+static SIMLOCAL struct cwnd A_cwnd;             /* congestion window, used if congestion_control is set */
+static SIMLOCAL int fec_first, fec_count;       /* first packet and number of packets of the current block */
+static SIMLOCAL char fec_xor[20];               /* XOR of the payloads of the current block */
+static SIMLOCAL int A_rwnd;                     /* flow control: the room B last advertised */
+
+/* the number of packets the sender may have awaiting an ACK */
+static int A_windowsize(void)
+{
+  int window = WINDOWSIZE;
+
+  if (congestion_control)
+    window = cwnd_window(&A_cwnd);
+  if (flow_control && A_rwnd < window)
+    window = A_rwnd > 0 ? A_rwnd : 1;
+  return window;
+}
+
+/* resend every packet awaiting an ACK, in one burst, and restart the timer */
+static void A_resendwindow(void)
+{
+  struct pkt burst[WINDOWSIZE];
+  int i;
+
+  for(i=0; i<windowcount; i++) {
+
+    if (TRACE > 0)
+      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+
+    burst[i] = buffer[(windowfirst+i) % WINDOWSIZE];
+    packets_resent++;
+  }
+  if (windowcount > 0) {
+    tolayer3_burst(A, burst, windowcount);
+    starttimer(A,RTT);
+  }
+}
+
+/* add a new packet to the parity of its block, and send the parity once the block is complete */
+static void A_addparity(const struct pkt *packet)
+{
+  struct pkt parity;
+  int i;
+
+  if (fec_count == 0) {
+    fec_first = packet->seqnum;
+    for ( i=0; i<20 ; i++ )
+      fec_xor[i] = 0;
+  }
+  for ( i=0; i<20 ; i++ )
+    fec_xor[i] ^= packet->payload[i];
+  if (++fec_count < fec_blocksize())
+    return;
+
+  parity.seqnum = PARITY;
+  parity.acknum = fec_first;
+  for ( i=0; i<20 ; i++ )
+    parity.payload[i] = fec_xor[i];
+  parity.checksum = ComputeChecksum(parity);
+  if (TRACE > 0)
+    printf("Sending parity of packets %d to %d to layer 3\n", fec_first, packet->seqnum);
+  tolayer3 (A, parity);
+  fec_parity_sent++;
+  fec_count = 0;
+}
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
 void A_output(struct msg message)
@@ -70,7 +169,7 @@ void A_output(struct msg message)
   int i;
 
   /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
+  if ( windowcount < A_windowsize()) {
     if (TRACE > 1)
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
 
@@ -86,6 +185,7 @@ void A_output(struct msg message)
     windowlast = (windowlast + 1) % WINDOWSIZE;
     buffer[windowlast] = sendpkt;
     windowcount++;
+    window_occupancy = windowcount;
 
     /* send out packet */
     if (TRACE > 0)
@@ -96,8 +196,11 @@ void A_output(struct msg message)
     if (windowcount == 1)
       starttimer(A,RTT);
 
+    if (fec_group > 0)
+      A_addparity(&sendpkt);
+
     /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    A_nextseqnum = (A_nextseqnum + 1) % seqspace();
   }
   /* if blocked,  window is full */
   else {
@@ -122,6 +225,10 @@ void A_input(struct pkt packet)
       printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
     total_ACKs_received++;
 
+    /* every ACK advertises the room B has after the packets it ACKs */
+    if (flow_control)
+      A_rwnd = packet.payload[1];
+
     /* check if new ACK or duplicate */
     if (windowcount != 0) {
           int seqfirst = buffer[windowfirst].seqnum;
@@ -139,7 +246,7 @@ void A_input(struct pkt packet)
             if (packet.acknum >= seqfirst)
               ackcount = packet.acknum + 1 - seqfirst;
             else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
+              ackcount = seqspace() - seqfirst + packet.acknum;
 
 	    /* slide window by the number of packets ACKed */
             windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
@@ -147,6 +254,10 @@ void A_input(struct pkt packet)
             /* delete the acked packets from window buffer */
             for (i=0; i<ackcount; i++)
               windowcount--;
+            window_occupancy = windowcount;
+
+            if (congestion_control)
+              cwnd_newack(&A_cwnd, ackcount);
 
 	    /* start timer again if there are still more unacked packets in window */
             stoptimer(A);
@@ -154,6 +265,13 @@ void A_input(struct pkt packet)
               starttimer(A, RTT);
 
           }
+          else if (congestion_control && cwnd_dupack(&A_cwnd)) {
+            /* third duplicate ACK: fast retransmit without waiting for the timer */
+            if (TRACE > 0)
+              printf("----A: third duplicate ACK %d, resend packets!\n",packet.acknum);
+            stoptimer(A);
+            A_resendwindow();
+          }
         }
         else
           if (TRACE > 0)
@@ -167,20 +285,13 @@ void A_input(struct pkt packet)
 /* called when A's timer goes off */
 void A_timerinterrupt(void)
 {
-  int i;
-
   if (TRACE > 0)
     printf("----A: time out,resend packets!\n");
 
-  for(i=0; i<windowcount; i++) {
-
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+  if (congestion_control)
+    cwnd_timeout(&A_cwnd);
 
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
-  }
+  A_resendwindow();
 }
 
 
@@ -197,48 +308,35 @@ void A_init(void)
 		     so initially this is set to -1
 		   */
   windowcount = 0;
+  window_occupancy = 0;
+  cwnd_init(&A_cwnd, WINDOWSIZE);
+  fec_count = 0;
+  A_rwnd = WINDOWSIZE;
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+static SIMLOCAL int expectedseqnum; /* the sequence number expected next by the receiver */
+static SIMLOCAL int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+static SIMLOCAL bool B_have[2 * WINDOWSIZE];         /* FEC: B_payload[seqnum] holds packet seqnum */
+static SIMLOCAL char B_payload[2 * WINDOWSIZE][20];  /* FEC: the last packets delivered and those kept ahead */
 
+/* flow control: can B's application take another message? */
+static bool B_room(void)
+{
+  return !flow_control || tolayer5_room(B) > 0;
+}
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+/* send an ACK for acknum */
+static void B_sendack(int acknum)
 {
   struct pkt sendpkt;
   int i;
 
-  /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
-
-    /* deliver to receiving application */
-    tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
-
-    /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
-  }
-  else {
-    /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0)
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
-    else
-      sendpkt.acknum = expectedseqnum - 1;
-  }
-
   /* create packet */
+  sendpkt.acknum = acknum;
   sendpkt.seqnum = B_nextseqnum;
   B_nextseqnum = (B_nextseqnum + 1) % 2;
 
@@ -246,6 +344,10 @@ void B_input(struct pkt packet)
   for ( i=0; i<20 ; i++ )
     sendpkt.payload[i] = '0';
 
+  /* flow control: advertise the room of the receiving application */
+  if (flow_control)
+    sendpkt.payload[1] = tolayer5_room(B) < WINDOWSIZE ? tolayer5_room(B) : WINDOWSIZE;
+
   /* computer checksum */
   sendpkt.checksum = ComputeChecksum(sendpkt);
 
@@ -253,12 +355,126 @@ void B_input(struct pkt packet)
   tolayer3 (B, sendpkt);
 }
 
+/* FEC: keep the payload of packet seqnum */
+static void B_keep(int seqnum, const char payload[20])
+{
+  int i;
+
+  for ( i=0; i<20 ; i++ )
+    B_payload[seqnum][i] = payload[i];
+  B_have[seqnum] = true;
+}
+
+/* deliver the payload of the packet B expects and, with FEC, the kept
+   packets that follow it; return the last sequence number delivered */
+static int B_deliver(const char payload[20])
+{
+  int last;
+
+  tolayer5(B, (char *)payload);
+  for (;;) {
+    last = expectedseqnum;
+    if (fec_group > 0 && payload != B_payload[last])
+      B_keep(last, payload);
+    expectedseqnum = (expectedseqnum + 1) % seqspace();
+    if (fec_group == 0)
+      break;
+
+    /* the oldest packet delivered leaves, its slot is now the newest one ahead */
+    B_have[(expectedseqnum + WINDOWSIZE - 1) % seqspace()] = false;
+    if (!B_have[expectedseqnum] || !B_room())
+      break;
+    payload = B_payload[expectedseqnum];
+    if (TRACE > 0)
+      printf("----B: delivering kept packet %d\n", expectedseqnum);
+    tolayer5(B, (char *)payload);
+  }
+  return last;
+}
+
+/* FEC: rebuild the packet B expects from the parity of its block, if it
+   is the only packet of the block B does not have */
+static bool B_repair(const struct pkt *parity, char payload[20])
+{
+  int first = parity->acknum;
+  int seq, i, j;
+
+  if (first < 0 || first >= seqspace() ||
+      (expectedseqnum - first + seqspace()) % seqspace() >= fec_blocksize())
+    return false;    /* the block does not hold the packet B expects */
+
+  for ( i=0; i<20 ; i++ )
+    payload[i] = parity->payload[i];
+  for (j=0; j<fec_blocksize(); j++) {
+    seq = (first + j) % seqspace();
+    if (seq == expectedseqnum)
+      continue;
+    if (!B_have[seq])
+      return false;  /* another packet of the block is missing too */
+    for ( i=0; i<20 ; i++ )
+      payload[i] ^= B_payload[seq][i];
+  }
+  return true;
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void B_input(struct pkt packet)
+{
+  char payload[20];
+  int ahead;
+
+  /* parity packets are never ACKed */
+  if (fec_group > 0 && packet.seqnum == PARITY) {
+    if (IsCorrupted(packet) || !B_room() || !B_repair(&packet, payload)) {
+      if (TRACE > 0)
+        printf("----B: parity of packets from %d repairs nothing, do nothing!\n", packet.acknum);
+      return;
+    }
+    if (TRACE > 0)
+      printf("----B: packet %d is rebuilt from its parity, send ACK!\n", expectedseqnum);
+    fec_repaired++;
+    B_sendack(B_deliver(payload));
+    return;
+  }
+
+  /* if not corrupted and received packet is in order, and the application has room for it */
+  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) && B_room() ) {
+    if (TRACE > 0)
+      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+    packets_received++;
+
+    /* deliver to receiving application, and send an ACK for the received packet */
+    B_sendack(B_deliver(packet.payload));
+  }
+  else {
+    /* with FEC, keep a packet ahead of the one expected until the gap is filled */
+    if (fec_group > 0 && !IsCorrupted(packet)) {
+      ahead = (packet.seqnum - expectedseqnum + seqspace()) % seqspace();
+      if (ahead > 0 && ahead < WINDOWSIZE && !B_have[packet.seqnum]) {
+        if (TRACE > 0)
+          printf("----B: packet %d is ahead of %d, keep it\n", packet.seqnum, expectedseqnum);
+        packets_received++;
+        B_keep(packet.seqnum, packet.payload);
+      }
+    }
+
+    /* packet is corrupted or out of order resend last ACK */
+    if (TRACE > 0)
+      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
+    B_sendack((expectedseqnum + seqspace() - 1) % seqspace());
+  }
+}
+
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
 void B_init(void)
 {
+  int i;
+
   expectedseqnum = 0;
   B_nextseqnum = 1;
+  for (i=0; i<2 * WINDOWSIZE; i++)
+    B_have[i] = false;
 }
 
 /******************************************************************************
@@ -274,3 +490,71 @@ void B_output(struct msg message)
 void B_timerinterrupt(void)
 {
 }
+
+/******************************************************************************
+ * Checkpointing: the complete state of both entities                         *
+ *****************************************************************************/
+
+struct gbn_state {
+  struct pkt buffer[WINDOWSIZE];
+  int windowfirst, windowlast;
+  int windowcount;
+  int A_nextseqnum;
+  struct cwnd A_cwnd;
+  int fec_first, fec_count;
+  char fec_xor[20];
+  int A_rwnd;
+  int expectedseqnum;
+  int B_nextseqnum;
+  bool B_have[2 * WINDOWSIZE];
+  char B_payload[2 * WINDOWSIZE][20];
+};
+
+size_t protocol_state_size(void)
+{
+  return sizeof(struct gbn_state);
+}
+
+void protocol_save_state(void *data)
+{
+  struct gbn_state *state = data;
+  int i;
+
+  for (i=0; i<WINDOWSIZE; i++)
+    state->buffer[i] = buffer[i];
+  state->windowfirst = windowfirst;
+  state->windowlast = windowlast;
+  state->windowcount = windowcount;
+  state->A_nextseqnum = A_nextseqnum;
+  state->A_cwnd = A_cwnd;
+  state->fec_first = fec_first;
+  state->fec_count = fec_count;
+  memcpy(state->fec_xor, fec_xor, sizeof(fec_xor));
+  state->A_rwnd = A_rwnd;
+  state->expectedseqnum = expectedseqnum;
+  state->B_nextseqnum = B_nextseqnum;
+  memcpy(state->B_have, B_have, sizeof(B_have));
+  memcpy(state->B_payload, B_payload, sizeof(B_payload));
+}
+
+void protocol_restore_state(const void *data)
+{
+  const struct gbn_state *state = data;
+  int i;
+
+  for (i=0; i<WINDOWSIZE; i++)
+    buffer[i] = state->buffer[i];
+  windowfirst = state->windowfirst;
+  windowlast = state->windowlast;
+  windowcount = state->windowcount;
+  A_nextseqnum = state->A_nextseqnum;
+  A_cwnd = state->A_cwnd;
+  fec_first = state->fec_first;
+  fec_count = state->fec_count;
+  memcpy(fec_xor, state->fec_xor, sizeof(fec_xor));
+  A_rwnd = state->A_rwnd;
+  expectedseqnum = state->expectedseqnum;
+  B_nextseqnum = state->B_nextseqnum;
+  memcpy(B_have, state->B_have, sizeof(B_have));
+  memcpy(B_payload, state->B_payload, sizeof(B_payload));
+}
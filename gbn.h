@@ -8,4 +8,12 @@ extern void A_timerinterrupt(void);
 /* included for extension to bidirectional communication */
 #define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
 extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
\ No newline at end of file
+extern void B_timerinterrupt(void);
+
+/* checkpointing of the protocol state (see simulator.h) */
+extern size_t protocol_state_size(void);
+extern void protocol_save_state(void *);
+extern void protocol_restore_state(const void *);
+
+/* the protocol's name, e.g. in result stores (see results.h) */
+extern const char protocol_name[];
@@ -0,0 +1,410 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "cwnd.h"
+#include "simulator.h"
+#include "snapshot.h"
+#include "profile.h"
+#include "batchmeans.h"
+#include "results.h"
+
+/* ******************************************************************
+   Interactive emulator: reads the simulation parameters from stdin,
+   runs the simulation to completion and prints its statistics.
+
+   Options:
+   -a src   traffic source (see simulator.h): uniform (default), poisson,
+            cbr, saturated, onoff:ON:OFF with mean on and off periods
+            ON > 0 and OFF >= 0, or trace:FILE with the arrival times in
+            FILE; poisson and cbr need an average time between messages
+            > 0
+   -c       enable the sender congestion window (see cwnd.h)
+   -N       SR only: B sends NAKs for the gaps it sees, and A resends a
+            NAKed packet at once (see sr.c)
+   -E k     GBN only: A sends a parity packet after every k packets, from
+            which B rebuilds a single lost packet without a resend (see
+            gbn.c)
+   -C rel   stop as soon as the 95% confidence intervals of the goodput,
+            latency and resends are within rel of their means, estimated
+            by batch means (see batchmeans.h)
+   -T t     warm-up time of -C, whose observations are dropped (default
+            0); only with -C
+   -D t     B's application takes t time units to read each message,
+            and B and A keep to the room in its buffer (flow control)
+   -B n     size of that buffer in messages (default 4); only with -D
+   -L       A and B draw from random number streams of their own: the
+            same run as -F, simulated sequentially
+   -r file  append the parameters and statistics of the run (of every
+            replication with -R) to the result store file (see results.h)
+   -w file  write the congestion window time series to file
+   -s n     print a statistics snapshot every n events
+   -S t     print a statistics snapshot every t time units
+   -f fmt   snapshot format: text (default), csv or json
+   -o file  write the snapshots to file instead of stdout
+   -p       profile the protocol callbacks and emulator routines (see
+            profile.h) and print the profile after the statistics
+   -P file  also write the profile to file as folded stacks
+   -F       simulate the run as a conservative parallel simulation of A
+            and B in two threads (see pdes.c), which implies -L, and
+            print its statistics and trace hash
+   -R n     simulate n Monte Carlo replications, replication i with seed
+            9999 + i (see montecarlo.c), and print the mean and 95%
+            confidence interval of their results
+   -W n     events each replication of -R runs before another one may be
+            swapped in (default 16384)
+   -w, -s, -S, -o, -p and -P are of a single sequential run and cannot be
+   combined with -F or -R, nor -F with -R or -C.
+**********************************************************************/
+
+static const char *results_file;   /* -r */
+
+static void usage(const char *program)
+{
+  printf("usage: %s [-a source] [-c] [-N] [-E k] [-C precision] [-T warmup] [-D drain] [-B rcvbuf] [-r resultfile] [-w cwndfile] [-s events] [-S time] [-f text|csv|json] [-o file] [-p] [-P file] [-L] [-F] [-R replications] [-W slice]\n", program);
+  exit(EXIT_FAILURE);
+}
+
+/* append a run to the result store, if there is one */
+static void store_run(const struct sim_params *params, int cc, const struct sim_stats *stats)
+{
+  int version;
+
+  if (results_file != NULL && results_append(results_file, protocol_name, params, cc, stats) != 0) {
+    version = results_version(results_file);
+    if (version >= 0 && version != RESULTS_VERSION)
+      printf("%s is a version %d result store, this emulator writes version %d\n", results_file,
+             version, RESULTS_VERSION);
+    else
+      printf("unable to append to result store %s\n", results_file);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* simulate the run with the parameters read by init() in parallel */
+static void run_parallel(void)
+{
+  struct flow flow;
+  long nwindows;
+
+  get_params(&flow.params);
+  flow.congestion_control = congestion_control;
+
+  nwindows = pdes_run(&flow);
+
+  printf("parallel run in %ld windows: time %f, %ld events, %d msgs, %d delivered, %d resent,"
+         " %d new_ACKs, %d window_full, trace hash %016llx\n",
+         nwindows, flow.stats.time, flow.stats.nevents, flow.stats.nsim,
+         flow.stats.messages_delivered, flow.stats.packets_resent, flow.stats.new_ACKs,
+         flow.stats.window_full, flow.stats.tracehash);
+  store_run(&flow.params, flow.congestion_control, &flow.stats);
+}
+
+/* parse the -a option into params, return 0 if it is not a valid source
+   (an on/off source needs periods ON > 0 and OFF >= 0, or the search for
+   the next on period never ends) */
+static int parse_source(char *arg, struct sim_params *params)
+{
+  if (strcmp(arg, "uniform") == 0)
+    params->source = SOURCE_UNIFORM;
+  else if (strcmp(arg, "poisson") == 0)
+    params->source = SOURCE_POISSON;
+  else if (strcmp(arg, "cbr") == 0)
+    params->source = SOURCE_CBR;
+  else if (strcmp(arg, "saturated") == 0)
+    params->source = SOURCE_SATURATED;
+  else if (sscanf(arg, "onoff:%f:%f", &params->on, &params->off) == 2) {
+    if (!(params->on > 0.0 && params->off >= 0.0))
+      return 0;
+    params->source = SOURCE_ONOFF;
+  }
+  else if (strncmp(arg, "trace:", 6) == 0) {
+    params->source = SOURCE_TRACE;
+    params->tracefile = arg + 6;
+  }
+  else
+    return 0;
+  return 1;
+}
+
+/* print the mean and 95% confidence interval of n values */
+static void print_interval(const char *name, const double *values, int n)
+{
+  double mean = 0.0, var = 0.0, halfwidth = 0.0;
+  int i;
+
+  for (i=0; i<n; i++)
+    mean += values[i];
+  mean /= n;
+  if (n > 1) {
+    for (i=0; i<n; i++)
+      var += (values[i] - mean) * (values[i] - mean);
+    var /= n - 1;
+    halfwidth = t95(n - 1) * sqrt(var / n);
+  }
+  printf("%-20s %14.4f +- %.4f\n", name, mean, halfwidth);
+}
+
+/* simulate nreps replications with the parameters read by init() */
+static void run_replications(int nreps, long slice)
+{
+  struct sim_params params;
+  struct flow *flows;
+  double *delivered, *resent, *acks, *full, *goodput;
+  long nswaps;
+  int i;
+
+  get_params(&params);
+  flows = malloc(nreps * sizeof(struct flow));
+  delivered = malloc(5 * nreps * sizeof(double));
+  if (flows == NULL || delivered == NULL) {
+    printf("memory allocation for replications failed.");
+    exit(EXIT_FAILURE);
+  }
+  resent = delivered + nreps;
+  acks = resent + nreps;
+  full = acks + nreps;
+  goodput = full + nreps;
+  for (i=0; i<nreps; i++) {
+    flows[i].params = params;
+    flows[i].params.seed = params.seed + i;
+    flows[i].congestion_control = congestion_control;
+  }
+
+  nswaps = montecarlo_run(flows, nreps, slice);
+
+  for (i=0; i<nreps; i++) {
+    printf("replication %d: seed %u, time %f, %ld events, %d delivered, %d resent, %d new_ACKs, %d window_full\n",
+           i, flows[i].params.seed, flows[i].stats.time, flows[i].stats.nevents,
+           flows[i].stats.messages_delivered, flows[i].stats.packets_resent,
+           flows[i].stats.new_ACKs, flows[i].stats.window_full);
+    delivered[i] = flows[i].stats.messages_delivered;
+    resent[i] = flows[i].stats.packets_resent;
+    acks[i] = flows[i].stats.new_ACKs;
+    full[i] = flows[i].stats.window_full;
+    goodput[i] = flows[i].stats.time > 0.0 ? delivered[i] / flows[i].stats.time : 0.0;
+    store_run(&flows[i].params, flows[i].congestion_control, &flows[i].stats);
+  }
+  printf("%d replications with %ld swaps, mean and 95%% confidence interval:\n", nreps, nswaps);
+  print_interval("delivered", delivered, nreps);
+  print_interval("resent", resent, nreps);
+  print_interval("new_ACKs", acks, nreps);
+  print_interval("window_full", full, nreps);
+  print_interval("goodput (msgs/time)", goodput, nreps);
+  free(delivered);
+  free(flows);
+}
+
+int main(int argc, char **argv)
+{
+  struct sim_params params = { 0 }, source = { 0 };
+  struct sim_stats stats;
+  const char *cwnd_name = NULL, *snapshot_name = NULL, *folded_name = NULL;
+  FILE *snapshot_file = stdout;
+  int snapshot_format = SNAPSHOT_TEXT;
+  long snapshot_events = 0;
+  double snapshot_interval = 0.0;
+  FILE *folded_file = NULL;
+  int profile = 0;
+  int parallel = 0, nreps = 0;
+  int nak = 0, fec = 0, streams = 0;
+  double precision = 0.0, warmup = 0.0;
+  int warmup_set = 0, rcvbuf_set = 0;
+  double drain = 0.0;
+  int rcvbuf = 4;
+  long slice = MONTECARLO_SLICE;
+  int opt;
+
+  source.source = SOURCE_UNIFORM;
+  while ((opt = getopt(argc, argv, "a:cNE:C:T:D:B:Lr:w:s:S:f:o:pP:FR:W:")) != -1) {
+    switch (opt) {
+    case 'a':
+      if (!parse_source(optarg, &source)) {
+        printf("unknown or invalid traffic source %s\n", optarg);
+        usage(argv[0]);
+      }
+      break;
+    case 'c':
+      congestion_control = 1;
+      break;
+    case 'N':
+      if (strcmp(protocol_name, "sr") != 0) {
+        printf("-N is only implemented by sr\n");
+        usage(argv[0]);
+      }
+      nak = 1;
+      break;
+    case 'E':
+      if (strcmp(protocol_name, "gbn") != 0) {
+        printf("-E is only implemented by gbn\n");
+        usage(argv[0]);
+      }
+      fec = atoi(optarg);
+      break;
+    case 'C':
+      precision = atof(optarg);
+      break;
+    case 'T':
+      warmup = atof(optarg);
+      warmup_set = 1;
+      break;
+    case 'D':
+      drain = atof(optarg);
+      break;
+    case 'B':
+      rcvbuf = atoi(optarg);
+      rcvbuf_set = 1;
+      break;
+    case 'L':
+      streams = 1;
+      break;
+    case 'r':
+      results_file = optarg;
+      break;
+    case 'w':
+      cwnd_name = optarg;
+      break;
+    case 's':
+      snapshot_events = atol(optarg);
+      break;
+    case 'S':
+      snapshot_interval = atof(optarg);
+      break;
+    case 'f':
+      if (strcmp(optarg, "csv") == 0)
+        snapshot_format = SNAPSHOT_CSV;
+      else if (strcmp(optarg, "json") == 0)
+        snapshot_format = SNAPSHOT_JSON;
+      else if (strcmp(optarg, "text") == 0)
+        snapshot_format = SNAPSHOT_TEXT;
+      else
+        usage(argv[0]);
+      break;
+    case 'o':
+      snapshot_name = optarg;
+      break;
+    case 'p':
+      profile = 1;
+      break;
+    case 'P':
+      profile = 1;
+      folded_name = optarg;
+      break;
+    case 'F':
+      parallel = 1;
+      streams = 1;
+      break;
+    case 'R':
+      nreps = atoi(optarg);
+      break;
+    case 'W':
+      slice = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  /* the cwnd log, snapshots and profile are of a single run */
+  if ((parallel || nreps > 0) &&
+      (cwnd_name != NULL || snapshot_events > 0 || snapshot_interval > 0.0 || snapshot_name != NULL || profile)) {
+    printf("-w, -s, -S, -o, -p and -P cannot be used with -F or -R\n");
+    usage(argv[0]);
+  }
+  /* nor can the parallel run stop early on batch means, which both A and B update */
+  if (parallel && (nreps > 0 || precision > 0.0)) {
+    printf("-R and -C cannot be used with -F\n");
+    usage(argv[0]);
+  }
+  /* the warm-up is that of the batch means */
+  if (warmup_set && !(precision > 0.0)) {
+    printf("-T needs -C\n");
+    usage(argv[0]);
+  }
+  /* and the buffer that of the flow control */
+  if (rcvbuf_set && !(drain > 0.0)) {
+    printf("-B needs -D\n");
+    usage(argv[0]);
+  }
+  if (cwnd_name != NULL) {
+    cwnd_log = fopen(cwnd_name, "w");
+    if (cwnd_log == NULL) {
+      printf("unable to open cwnd log file %s\n", cwnd_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (snapshot_name != NULL) {
+    snapshot_file = fopen(snapshot_name, "w");
+    if (snapshot_file == NULL) {
+      printf("unable to open snapshot file %s\n", snapshot_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (folded_name != NULL) {
+    folded_file = fopen(folded_name, "w");
+    if (folded_file == NULL) {
+      printf("unable to open profile file %s\n", folded_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  init();
+  get_params(&params);
+  if ((source.source == SOURCE_POISSON || source.source == SOURCE_CBR) && !(params.lambda > 0.0)) {
+    printf("the %s source needs an average time between messages > 0\n",
+           source.source == SOURCE_POISSON ? "poisson" : "cbr");
+    usage(argv[0]);
+  }
+  if (source.source != SOURCE_UNIFORM || nak || fec > 0 || precision > 0.0 || drain > 0.0 || streams) {
+    /* start over with the same parameters and the chosen options */
+    get_params(&params);
+    params.source = source.source;
+    params.on = source.on;
+    params.off = source.off;
+    params.tracefile = source.tracefile;
+    params.nak = nak;
+    params.fec = fec;
+    params.warmup = warmup;
+    params.precision = precision;
+    params.drain = drain;
+    params.rcvbuf = rcvbuf;
+    params.streams = streams;
+    init_params(&params);
+  }
+  if (parallel) {
+    run_parallel();
+    return EXIT_SUCCESS;
+  }
+  if (nreps > 0) {
+    run_replications(nreps, slice > 0 ? slice : MONTECARLO_SLICE);
+    return EXIT_SUCCESS;
+  }
+  A_init();
+  B_init();
+  if (snapshot_events > 0 || snapshot_interval > 0.0)
+    snapshot_start(snapshot_file, snapshot_format, snapshot_events, snapshot_interval);
+  if (profile)
+    profile_start();
+
+  run_simulation(-1);
+
+  profile_stop();
+  snapshot_finish();
+  print_statistics();
+  get_params(&params);
+  get_statistics(&stats);
+  store_run(&params, congestion_control, &stats);
+  if (profile)
+    profile_print(stdout);
+  if (folded_file != NULL) {
+    profile_write_folded(folded_file);
+    fclose(folded_file);
+  }
+  if (cwnd_log != NULL)
+    fclose(cwnd_log);
+  if (snapshot_file != stdout)
+    fclose(snapshot_file);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "cwnd.h"
+#include "simulator.h"
+#include "rng.h"
+
+/* ******************************************************************
+   Monte Carlo replications with a multi-lane random number generator.
+
+   The flows are replications of a run, simulated RNG_LANES at a time on
+   the calling thread.  Their random numbers all come from one struct
+   rng_lanes, lane i seeded with flow i's seed, which steps every lane
+   with one vector add (see rng.c) into a block of RNG_BLOCK numbers per
+   lane.  Each replication reads its own lane in place through
+   set_random_source, so it sees exactly the numbers of a sequential run with its seed.
+
+   Only one replication can be in the emulator's variables at a time, so
+   each one stays resident for a slice of many events, and is only then
+   swapped out into a checkpoint if another one is to run.  The next to
+   run is always the one with the most unread numbers in its lane, which
+   keeps the lanes within about a slice's worth of numbers of each other
+   however fast each one consumes them.
+
+   Only the generator is vectorised: the replications take different
+   branches in tolayer3 and the protocols, so the events themselves are
+   simulated one replication at a time.
+**********************************************************************/
+
+#define RNG_BLOCK 256   /* numbers generated per lane at a time */
+
+struct montecarlo;
+
+/* one lane: its replication reads numbers[] from source.next to source.end */
+struct lane {
+  struct random_source source;    /* first, so a source is its lane */
+  struct montecarlo *mc;
+  uint32_t *numbers;
+  int size;
+  int done;             /* its replication has finished, or there is none */
+};
+
+struct montecarlo {
+  struct rng_lanes rng;
+  struct lane lanes[RNG_LANES];
+  uint32_t block[RNG_BLOCK][RNG_LANES];
+};
+
+/* generate the next block of every lane, appending it to the lane's unread numbers */
+static void refill(struct montecarlo *mc)
+{
+  struct lane *l;
+  int i, j, head, tail;
+
+  rng_lanes_fill(&mc->rng, mc->block, RNG_BLOCK);
+  for (i=0; i<RNG_LANES; i++) {
+    l = &mc->lanes[i];
+    if (l->done)
+      continue;
+    head = l->source.next - l->numbers;
+    tail = l->source.end - l->numbers;
+    if (tail + RNG_BLOCK > l->size && head > 0) {
+      /* make room by dropping the numbers already read */
+      memmove(l->numbers, l->numbers + head, (tail - head) * sizeof(uint32_t));
+      tail -= head;
+      head = 0;
+    }
+    if (tail + RNG_BLOCK > l->size) {
+      l->size = 2 * (tail + RNG_BLOCK);
+      l->numbers = realloc(l->numbers, l->size * sizeof(uint32_t));
+      if (l->numbers == NULL) {
+        printf("memory allocation for random numbers failed.");
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (j=0; j<RNG_BLOCK; j++)
+      l->numbers[tail + j] = mc->block[j][i];
+    l->source.next = l->numbers + head;
+    l->source.end = l->numbers + tail + RNG_BLOCK;
+  }
+}
+
+/* the refill() of a replication's source */
+static void lane_refill(struct random_source *source)
+{
+  refill(((struct lane *)source)->mc);
+}
+
+/* numbers generated for a lane but not yet read */
+static long unread(const struct lane *l)
+{
+  return l->source.end - l->source.next;
+}
+
+/* simulate flows[0..nflows-1], nflows <= RNG_LANES; return the number of swaps */
+static long run_lanes(struct montecarlo *mc, struct flow *flows, int nflows, long slice)
+{
+  struct checkpoint *cp[RNG_LANES];
+  unsigned int seeds[RNG_LANES];
+  long nswaps = 0;
+  int i, next, live = -1, left = nflows;
+
+  for (i=0; i<RNG_LANES; i++) {
+    seeds[i] = i < nflows ? flows[i].params.seed : 1;
+    mc->lanes[i].mc = mc;
+    mc->lanes[i].source.next = mc->lanes[i].source.end = mc->lanes[i].numbers;
+    mc->lanes[i].source.refill = lane_refill;
+    mc->lanes[i].done = i >= nflows;
+    cp[i] = NULL;
+  }
+  rng_lanes_seed(&mc->rng, seeds);
+
+  while (left > 0) {
+    /* the replication furthest behind runs next */
+    next = -1;
+    for (i=0; i<nflows; i++)
+      if (!mc->lanes[i].done && (next < 0 || unread(&mc->lanes[i]) > unread(&mc->lanes[next])))
+        next = i;
+
+    if (next != live) {
+      if (live >= 0 && !mc->lanes[live].done) {
+        cp[live] = checkpoint_save();
+        nswaps++;
+      }
+      set_random_source(&mc->lanes[next].source);
+      congestion_control = flows[next].congestion_control;
+      if (cp[next] != NULL) {
+        checkpoint_restore(cp[next]);
+        checkpoint_free(cp[next]);
+        cp[next] = NULL;
+      }
+      else {
+        init_params(&flows[next].params);
+        A_init();
+        B_init();
+      }
+      live = next;
+    }
+
+    run_simulation(slice);
+    if (evlist == NULL) {
+      get_statistics(&flows[live].stats);
+      mc->lanes[live].done = 1;
+      left--;
+    }
+  }
+  set_random_source(NULL);
+  return nswaps;
+}
+
+long montecarlo_run(struct flow *flows, int nflows, long slice)
+{
+  struct montecarlo *mc;
+  long nswaps = 0;
+  int i, n;
+
+  mc = calloc(1, sizeof(struct montecarlo));
+  if (mc == NULL) {
+    printf("memory allocation for Monte Carlo run failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<nflows; i+=RNG_LANES) {
+    n = nflows - i < RNG_LANES ? nflows - i : RNG_LANES;
+    nswaps += run_lanes(mc, flows + i, n, slice);
+  }
+  for (i=0; i<RNG_LANES; i++)
+    free(mc->lanes[i].numbers);
+  free(mc);
+  return nswaps;
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "cwnd.h"
+#include "simulator.h"
+
+/* ******************************************************************
+   Conservative parallel simulation of one run.
+
+   A and B are two logical processes, each simulated by a thread of its
+   own with its own event list (all emulator and protocol variables are
+   thread-local, see SIMLOCAL in emulator.h).  They only interact
+   through the medium, whose delay is at least LOOKAHEAD: a packet sent
+   at time t never arrives before t + LOOKAHEAD.  So the run proceeds in
+   time windows: if T is the time of the earliest event of either
+   process, neither can receive a packet before T + LOOKAHEAD, and both
+   simulate every event before that independently.  Then they swap the
+   packets they sent during the window, and start the next one.
+
+   The result is the same run as a sequential one, provided that
+   - A and B draw from random number streams of their own (streams in
+     struct sim_params), as the sequential run must then do too: the
+     order in which A's and B's events draw from a single stream is only
+     known once both have been simulated;
+   - the trace hash is folded over the events of both processes merged
+     in time order, which A does after each window.  Events of A and B
+     at exactly the same time, which needs two sums of random delays to
+     be equal, are taken A first, which a sequential run need not do.
+
+   With only two processes and a few events per window, the threads
+   spend most of their time at the barriers: this shows that the
+   results do not depend on the schedule rather than making a single run
+   faster.
+**********************************************************************/
+
+#define LOOKAHEAD 1.0   /* minimum delay of the medium (see packet_arrival()) */
+
+struct pdes {
+  struct flow *flow;
+  pthread_barrier_t barrier;
+  double next[2];             /* time of the next event of A and B */
+  struct event *sent[2];      /* packets sent by A and B in the window */
+  struct event *simulated[2]; /* events simulated by A and B in the window */
+  struct sim_stats stats[2];
+  long nwindows;
+};
+
+struct lp_arg {
+  struct pdes *pdes;
+  int entity;
+};
+
+static void *lp_main(void *arg)
+{
+  struct pdes *p = ((struct lp_arg *)arg)->pdes;
+  int entity = ((struct lp_arg *)arg)->entity, other = 1 - entity;
+  double start;
+
+  congestion_control = p->flow->congestion_control;
+  lp_init(&p->flow->params, entity);
+  if (entity == A)
+    A_init();
+  else
+    B_init();
+  for (;;) {
+    p->next[entity] = lp_next();
+    pthread_barrier_wait(&p->barrier);
+    start = fmin(p->next[A], p->next[B]);
+    if (start == DBL_MAX)
+      break;
+
+    /* every packet sent from start on arrives at start + LOOKAHEAD or
+       later, even rounded: the window ends just before */
+    run_until(nextafter(start + LOOKAHEAD, 0.0));
+    p->sent[entity] = lp_take_sent();
+    p->simulated[entity] = lp_take_simulated();
+    pthread_barrier_wait(&p->barrier);
+
+    lp_receive(p->sent[other]);
+    if (entity == A) {
+      lp_hash(p->simulated[A], p->simulated[B]);
+      p->nwindows++;
+    }
+  }
+  get_statistics(&p->stats[entity]);
+  return NULL;
+}
+
+/* the statistics of the run: those of A, with B's counters added */
+static void add_stats(struct sim_stats *s, const struct sim_stats *b)
+{
+  s->time = fmax(s->time, b->time);
+  s->nevents += b->nevents;
+  s->nsim += b->nsim;
+  s->window_full += b->window_full;
+  s->total_ACKs_received += b->total_ACKs_received;
+  s->packets_resent += b->packets_resent;
+  s->new_ACKs += b->new_ACKs;
+  s->packets_received += b->packets_received;
+  s->messages_delivered += b->messages_delivered;
+  s->ntolayer3 += b->ntolayer3;
+  s->nlost += b->nlost;
+  s->ncorrupt += b->ncorrupt;
+  s->nevlist += b->nevlist;
+  s->ninflight += b->ninflight;
+  s->window_occupancy += b->window_occupancy;
+  s->fec_parity_sent += b->fec_parity_sent;
+  s->fec_repaired += b->fec_repaired;
+  s->messages_read += b->messages_read;
+}
+
+long pdes_run(struct flow *flow)
+{
+  struct pdes p;
+  struct lp_arg args[2];
+  pthread_t threads[2];
+  int i;
+
+  if (!flow->params.streams || flow->params.precision > 0.0) {
+    printf("a parallel simulation needs streams and no precision\n");
+    exit(EXIT_FAILURE);
+  }
+  p.flow = flow;
+  p.nwindows = 0;
+  pthread_barrier_init(&p.barrier, NULL, 2);
+  for (i=0; i<2; i++) {
+    args[i].pdes = &p;
+    args[i].entity = i == 0 ? A : B;
+    if (pthread_create(&threads[i], NULL, lp_main, &args[i]) != 0) {
+      printf("unable to start the threads of the parallel simulation\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (i=0; i<2; i++)
+    pthread_join(threads[i], NULL);
+  pthread_barrier_destroy(&p.barrier);
+
+  flow->stats = p.stats[A];
+  add_stats(&flow->stats, &p.stats[B]);
+  return p.nwindows;
+}
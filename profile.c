@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "profile.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* ******************************************************************
+   Per-section profiling (see profile.h).
+
+   The profile is a tree of call paths: node 0 is the root, and the
+   child of a node for a section is the path extended by that section.
+   Entering a section moves down the tree and pushes the tick count,
+   leaving it adds the elapsed ticks to the node and moves back up.
+**********************************************************************/
+
+#define PROFILE_MAXNODES 256   /* call paths recorded, further ones are ignored */
+#define PROFILE_MAXDEPTH 32    /* sections nested in each other */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICK_UNIT "cycles"
+static inline unsigned long long ticks(void)
+{
+  return __rdtsc();
+}
+#else
+#define TICK_UNIT "ns"
+static inline unsigned long long ticks(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static const char *names[PROF_NSECTIONS] = {
+  "A_output", "B_output", "A_input", "B_input", "A_timerinterrupt", "B_timerinterrupt",
+  "tolayer3", "tolayer5", "starttimer", "stoptimer", "insertevent",
+  "generate_next_arrival", "malloc", "layer5_read"
+};
+
+struct node {
+  int section;                    /* -1 for the root */
+  int parent;
+  int child[PROF_NSECTIONS];      /* 0 if the path has not been seen */
+  unsigned long long calls;
+  unsigned long long ticks;       /* including the children */
+};
+
+SIMLOCAL int profiling = 0;
+
+static SIMLOCAL struct node nodes[PROFILE_MAXNODES];
+static SIMLOCAL int nnodes;
+static SIMLOCAL int current;                    /* node of the innermost section */
+static SIMLOCAL unsigned long long started[PROFILE_MAXDEPTH];
+static SIMLOCAL int depth;
+static SIMLOCAL int untracked;                  /* sections entered past the limits */
+static SIMLOCAL int overflowed;                 /* some sections were not recorded */
+static SIMLOCAL struct timespec wallstart;
+static SIMLOCAL double wallns;                  /* wall-clock time profiled */
+
+static void newnode(int n, int section, int parent)
+{
+  memset(&nodes[n], 0, sizeof(nodes[n]));
+  nodes[n].section = section;
+  nodes[n].parent = parent;
+}
+
+void profile_enter(int section)
+{
+  int n;
+
+  if (untracked > 0 || depth == PROFILE_MAXDEPTH) {
+    untracked++;
+    overflowed = 1;
+    return;
+  }
+  n = nodes[current].child[section];
+  if (n == 0) {
+    if (nnodes == PROFILE_MAXNODES) {
+      untracked++;
+      overflowed = 1;
+      return;
+    }
+    n = nnodes++;
+    newnode(n, section, current);
+    nodes[current].child[section] = n;
+  }
+  current = n;
+  started[depth++] = ticks();
+}
+
+void profile_exit(void)
+{
+  if (untracked > 0) {
+    untracked--;
+    return;
+  }
+  if (depth == 0)
+    return;
+  nodes[current].ticks += ticks() - started[--depth];
+  nodes[current].calls++;
+  current = nodes[current].parent;
+}
+
+void profile_start(void)
+{
+  newnode(0, -1, 0);
+  nnodes = 1;
+  current = 0;
+  depth = 0;
+  untracked = 0;
+  overflowed = 0;
+  wallns = 0.0;
+  clock_gettime(CLOCK_MONOTONIC, &wallstart);
+  profiling = 1;
+  started[depth++] = ticks();
+}
+
+void profile_stop(void)
+{
+  struct timespec now;
+
+  if (!profiling)
+    return;
+  while (depth > 0)
+    profile_exit();           /* the root, and any section left open */
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  wallns = (now.tv_sec - wallstart.tv_sec) * 1e9 + (now.tv_nsec - wallstart.tv_nsec);
+  profiling = 0;
+}
+
+/* ticks spent in node n itself, not in its children */
+static unsigned long long selfticks(int n)
+{
+  unsigned long long t = nodes[n].ticks;
+  int i;
+
+  for (i=0; i<PROF_NSECTIONS; i++)
+    if (nodes[n].child[i] != 0)
+      t -= nodes[nodes[n].child[i]].ticks;
+  return t;
+}
+
+void profile_print(FILE *out)
+{
+  unsigned long long calls[PROF_NSECTIONS], total[PROF_NSECTIONS], self[PROF_NSECTIONS];
+  double nspertick, all;
+  int i, n;
+
+  if (nnodes == 0)
+    return;
+  memset(calls, 0, sizeof(calls));
+  memset(total, 0, sizeof(total));
+  memset(self, 0, sizeof(self));
+  for (n=1; n<nnodes; n++) {
+    calls[nodes[n].section] += nodes[n].calls;
+    total[nodes[n].section] += nodes[n].ticks;
+    self[nodes[n].section] += selfticks(n);
+  }
+  all = nodes[0].ticks > 0 ? nodes[0].ticks : 1;
+  nspertick = wallns / all;
+
+  fprintf(out, "profile: %llu %s in %.3f s\n", nodes[0].ticks, TICK_UNIT, wallns / 1e9);
+  fprintf(out, "%-22s %12s %16s %16s %12s %8s\n",
+          "section", "calls", "total", "self", "ns/call", "self %");
+  fprintf(out, "%-22s %12d %16llu %16llu %12s %7.2f%%\n", "run (event loop)", 1,
+          nodes[0].ticks, selfticks(0), "", 100.0 * selfticks(0) / all);
+  for (i=0; i<PROF_NSECTIONS; i++)
+    if (calls[i] > 0)
+      fprintf(out, "%-22s %12llu %16llu %16llu %12.1f %7.2f%%\n", names[i], calls[i],
+              total[i], self[i], total[i] * nspertick / calls[i], 100.0 * self[i] / all);
+  if (overflowed)
+    fprintf(out, "(some call paths were too deep or too many to record)\n");
+}
+
+/* write the path from the root to node n */
+static void write_path(FILE *out, int n)
+{
+  if (n == 0) {
+    fprintf(out, "run");
+    return;
+  }
+  write_path(out, nodes[n].parent);
+  fprintf(out, ";%s", names[nodes[n].section]);
+}
+
+void profile_write_folded(FILE *out)
+{
+  unsigned long long t;
+  int n;
+
+  for (n=0; n<nnodes; n++) {
+    t = selfticks(n);
+    if (t == 0)
+      continue;
+    write_path(out, n);
+    fprintf(out, " %llu\n", t);
+  }
+}
@@ -0,0 +1,56 @@
+/* ******************************************************************
+   Built-in profiling of the protocol callbacks and emulator routines.
+
+   After profile_start() the emulator counts the calls of every
+   section below and the time spent in them, measured with the
+   processor's time stamp counter (clock_gettime where there is none),
+   separately for every call path: A_input calling tolayer3 calling
+   insertevent is a different path from starttimer calling insertevent.
+   profile_print() reports the calls, total and self time of each
+   section and of the event loop itself (the root, "run"), and
+   profile_write_folded() writes the self time of every path as folded
+   stacks ("run;A_input;tolayer3;insertevent 1234") for flame graph
+   tools.
+
+   When profiling is off the emulator's only cost is one test of
+   `profiling` per section entered.
+**********************************************************************/
+#include <stdio.h>
+
+/* the sections */
+#define PROF_A_OUTPUT         0
+#define PROF_B_OUTPUT         1
+#define PROF_A_INPUT          2
+#define PROF_B_INPUT          3
+#define PROF_A_TIMER          4
+#define PROF_B_TIMER          5
+#define PROF_TOLAYER3         6
+#define PROF_TOLAYER5         7
+#define PROF_STARTTIMER       8
+#define PROF_STOPTIMER        9
+#define PROF_INSERTEVENT     10
+#define PROF_ARRIVAL         11   /* generate_next_arrival */
+#define PROF_MALLOC          12   /* allocation of events and packets */
+#define PROF_LAYER5_READ     13   /* B's application reads a message (-D) */
+#define PROF_NSECTIONS       14
+
+extern SIMLOCAL int profiling;   /* set between profile_start() and profile_stop() */
+
+#define PROFILE_ENTER(section) do { if (profiling) profile_enter(section); } while (0)
+#define PROFILE_EXIT()         do { if (profiling) profile_exit(); } while (0)
+
+/* a section starts or ends; calls must nest */
+extern void profile_enter(int section);
+extern void profile_exit(void);
+
+/* discard the previous profile and start profiling */
+extern void profile_start(void);
+
+/* stop profiling; the profile is kept until the next profile_start() */
+extern void profile_stop(void);
+
+/* print the profile of each section */
+extern void profile_print(FILE *out);
+
+/* write the self time of every call path, in ticks, as folded stacks */
+extern void profile_write_folded(FILE *out);
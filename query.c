@@ -0,0 +1,418 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "simulator.h"
+#include "results.h"
+
+/* ******************************************************************
+   Query tool for result stores (see results.h): filters the runs of a
+   store and prints chosen columns, or aggregates of them by group,
+   straight from the memory-mapped columns.
+
+   usage: query [-w condition]... [-g column]... file [output]...
+   -w condition  keep only the runs where column op value holds, op
+                 being one of = != < <= > >=; tag columns (protocol)
+                 only take = and !=, and real columns compare at single
+                 precision, the precision of the parameters; the value
+                 of an unsigned column (tracehash) may be in hex (0x...)
+   -g column     aggregate the runs by the values of column; several -g
+                 group by all of them, in order
+   output        a column, or count, or mean, sd, min, max or sum of a
+                 column written as fn(column)
+
+   Without outputs, the columns of the store are listed.  Without an
+   aggregate or -g, every run kept is printed; otherwise one line per
+   group (all the runs kept, without -g), sorted by the group columns,
+   in which a plain column must be one of the -g columns.
+
+   example: mean packet resends by loss probability and protocol
+     query -g protocol -g lossprob results.rs 'mean(packets_resent)' count
+**********************************************************************/
+
+#define MAXTERMS 32
+
+#define OP_EQ 0
+#define OP_NE 1
+#define OP_LT 2
+#define OP_LE 3
+#define OP_GT 4
+#define OP_GE 5
+
+#define AGG_NONE  0
+#define AGG_COUNT 1
+#define AGG_MEAN  2
+#define AGG_SD    3
+#define AGG_MIN   4
+#define AGG_MAX   5
+#define AGG_SUM   6
+
+static const char *const aggnames[] = { "", "count", "mean", "sd", "min", "max", "sum" };
+
+struct condition {
+  int column;
+  int op;
+  double value;
+  uint64_t uvalue;        /* the value of a RESULTS_UINT column, exactly */
+  char tag[9];
+};
+
+struct output {
+  const char *text;       /* as written */
+  int agg;                /* AGG_NONE for a plain column */
+  int column;             /* -1 for count */
+};
+
+static struct results *store;
+static int groups[MAXTERMS], ngroups;
+
+static void usage(const char *program)
+{
+  printf("usage: %s [-w condition]... [-g column]... file [output]...\n", program);
+  exit(EXIT_FAILURE);
+}
+
+static int column(const char *name)
+{
+  int k = results_find(store, name);
+
+  if (k < 0) {
+    printf("no column %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+  return k;
+}
+
+static void parse_condition(const char *text, struct condition *c)
+{
+  static const char *const ops[] = { "!=", "<=", ">=", "=", "<", ">" };
+  static const int codes[] = { OP_NE, OP_LE, OP_GE, OP_EQ, OP_LT, OP_GT };
+  char name[RESULTS_NAMELEN];
+  const char *p;
+  size_t len;
+  int i;
+
+  len = strcspn(text, "!=<>");
+  if (len == 0 || len >= sizeof(name) || text[len] == '\0') {
+    printf("bad condition %s\n", text);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(name, text, len);
+  name[len] = '\0';
+  c->column = column(name);
+  for (i=0; i<6 && strncmp(text + len, ops[i], strlen(ops[i])) != 0; i++)
+    ;
+  if (i == 6) {
+    printf("bad condition %s\n", text);
+    exit(EXIT_FAILURE);
+  }
+  c->op = codes[i];
+  p = text + len + strlen(ops[i]);
+  if (store->columns[c->column].type == RESULTS_TAG) {
+    if (c->op != OP_EQ && c->op != OP_NE) {
+      printf("tag column %s only takes = and !=\n", name);
+      exit(EXIT_FAILURE);
+    }
+    snprintf(c->tag, sizeof(c->tag), "%s", p);
+  }
+  else if (store->columns[c->column].type == RESULTS_UINT)
+    c->uvalue = strtoull(p, NULL, 0);
+  else
+    c->value = atof(p);
+}
+
+static void parse_output(const char *text, struct output *o)
+{
+  char name[RESULTS_NAMELEN];
+  const char *open = strchr(text, '(');
+  size_t len;
+
+  o->text = text;
+  o->agg = AGG_NONE;
+  o->column = -1;
+  if (strcmp(text, "count") == 0) {
+    o->agg = AGG_COUNT;
+    return;
+  }
+  if (open == NULL) {
+    o->column = column(text);
+    return;
+  }
+  for (o->agg=AGG_MEAN; o->agg<=AGG_SUM; o->agg++)
+    if (strlen(aggnames[o->agg]) == (size_t)(open - text) &&
+        strncmp(text, aggnames[o->agg], open - text) == 0)
+      break;
+  len = strlen(open + 1);
+  if (o->agg > AGG_SUM || len < 2 || len > sizeof(name) || open[len] != ')') {
+    printf("bad output %s\n", text);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(name, open + 1, len - 1);
+  name[len - 1] = '\0';
+  o->column = column(name);
+  if (store->columns[o->column].type == RESULTS_TAG) {
+    printf("cannot aggregate tag column %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* compare two values of column k, reals at single precision */
+static int compare_values(int k, double x, double y)
+{
+  if (store->columns[k].type == RESULTS_REAL) {
+    x = (float)x;
+    y = (float)y;
+  }
+  return x < y ? -1 : x > y;
+}
+
+/* the value of a RESULTS_INT cell, exactly */
+static int64_t intcell(int k, uint64_t row)
+{
+  int64_t i;
+
+  memcpy(&i, results_cell(store, k, row), 8);
+  return i;
+}
+
+/* the value of a RESULTS_UINT cell, exactly */
+static uint64_t uintcell(int k, uint64_t row)
+{
+  uint64_t u;
+
+  memcpy(&u, results_cell(store, k, row), 8);
+  return u;
+}
+
+/* compare two cells of column k, tags as text */
+static int compare_cells(int k, uint64_t a, uint64_t b)
+{
+  int64_t i, j;
+  uint64_t u, v;
+
+  switch (store->columns[k].type) {
+  case RESULTS_TAG:
+    return memcmp(results_cell(store, k, a), results_cell(store, k, b), 8);
+  case RESULTS_INT:
+    i = intcell(k, a);
+    j = intcell(k, b);
+    return i < j ? -1 : i > j;
+  case RESULTS_UINT:
+    u = uintcell(k, a);
+    v = uintcell(k, b);
+    return u < v ? -1 : u > v;
+  default:
+    return compare_values(k, results_value(store, k, a), results_value(store, k, b));
+  }
+}
+
+static int holds(const struct condition *c, uint64_t row)
+{
+  char tag[9];
+  uint64_t u;
+  int cmp;
+
+  if (store->columns[c->column].type == RESULTS_TAG) {
+    results_tag(store, c->column, row, tag);
+    cmp = strcmp(tag, c->tag);
+  }
+  else if (store->columns[c->column].type == RESULTS_UINT) {
+    u = uintcell(c->column, row);
+    cmp = u < c->uvalue ? -1 : u > c->uvalue;
+  }
+  else
+    cmp = compare_values(c->column, results_value(store, c->column, row), c->value);
+  switch (c->op) {
+  case OP_EQ: return cmp == 0;
+  case OP_NE: return cmp != 0;
+  case OP_LT: return cmp < 0;
+  case OP_LE: return cmp <= 0;
+  case OP_GT: return cmp > 0;
+  default:    return cmp >= 0;
+  }
+}
+
+/* qsort() order of rows by the group columns */
+static int compare_rows(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  int i, cmp;
+
+  for (i=0; i<ngroups; i++)
+    if ((cmp = compare_cells(groups[i], x, y)) != 0)
+      return cmp;
+  return x < y ? -1 : x > y;
+}
+
+static void print_cell(int k, uint64_t row)
+{
+  char tag[9];
+
+  switch (store->columns[k].type) {
+  case RESULTS_TAG:
+    results_tag(store, k, row, tag);
+    printf(" %14s", tag);
+    break;
+  case RESULTS_INT:
+    printf(" %14lld", (long long)intcell(k, row));
+    break;
+  case RESULTS_UINT:
+    printf(" %14llu", (unsigned long long)uintcell(k, row));
+    break;
+  default:
+    printf(" %14g", results_value(store, k, row));
+    break;
+  }
+}
+
+/* print the aggregates of rows[0..n-1], which are one group */
+static void print_group(const uint64_t *rows, size_t n, const struct output *outputs, int noutputs)
+{
+  double x, sum, sumsq, min, max, mean;
+  size_t j;
+  int i;
+
+  for (i=0; i<noutputs; i++) {
+    if (outputs[i].agg == AGG_NONE) {
+      print_cell(outputs[i].column, rows[0]);
+      continue;
+    }
+    if (outputs[i].agg == AGG_COUNT) {
+      printf(" %14zu", n);
+      continue;
+    }
+    sum = sumsq = 0.0;
+    min = max = results_value(store, outputs[i].column, rows[0]);
+    for (j=0; j<n; j++) {
+      x = results_value(store, outputs[i].column, rows[j]);
+      sum += x;
+      sumsq += x * x;
+      if (x < min)
+        min = x;
+      if (x > max)
+        max = x;
+    }
+    mean = sum / n;
+    switch (outputs[i].agg) {
+    case AGG_MEAN: x = mean; break;
+    case AGG_SD:   x = n > 1 ? sqrt(fmax(0.0, (sumsq - n * mean * mean) / (n - 1))) : 0.0; break;
+    case AGG_MIN:  x = min; break;
+    case AGG_MAX:  x = max; break;
+    default:       x = sum; break;
+    }
+    printf(" %14g", x);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  static const char *const types[] = { "int", "real", "tag", "uint" };
+  const char *wheres[MAXTERMS], *groupnames[MAXTERMS];
+  struct condition conditions[MAXTERMS];
+  struct output outputs[MAXTERMS];
+  int nconditions = 0, noutputs, aggregate;
+  uint64_t *rows, row;
+  size_t nrows = 0, first, j;
+  int i, k, opt, version;
+
+  while ((opt = getopt(argc, argv, "w:g:")) != -1) {
+    switch (opt) {
+    case 'w':
+      if (nconditions == MAXTERMS)
+        usage(argv[0]);
+      wheres[nconditions++] = optarg;
+      break;
+    case 'g':
+      if (ngroups == MAXTERMS)
+        usage(argv[0]);
+      groupnames[ngroups++] = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc || argc - optind - 1 > MAXTERMS)
+    usage(argv[0]);
+  store = results_open(argv[optind]);
+  if (store == NULL) {
+    version = results_version(argv[optind]);
+    if (version >= 0 && version != RESULTS_VERSION)
+      printf("%s is a version %d result store, this query reads version %d\n", argv[optind],
+             version, RESULTS_VERSION);
+    else
+      printf("%s is not a result store\n", argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+
+  noutputs = argc - optind - 1;
+  if (noutputs == 0) {
+    printf("%llu runs, %u columns:\n", (unsigned long long)store->header->nrows,
+           store->header->ncolumns);
+    for (k=0; k<(int)store->header->ncolumns; k++)
+      printf("  %-24s %s\n", store->columns[k].name, types[store->columns[k].type % 4]);
+    results_close(store);
+    return EXIT_SUCCESS;
+  }
+
+  for (i=0; i<nconditions; i++)
+    parse_condition(wheres[i], &conditions[i]);
+  for (i=0; i<ngroups; i++)
+    groups[i] = column(groupnames[i]);
+  aggregate = ngroups > 0;
+  for (i=0; i<noutputs; i++) {
+    parse_output(argv[optind + 1 + i], &outputs[i]);
+    if (outputs[i].agg != AGG_NONE)
+      aggregate = 1;
+  }
+  for (i=0; i<noutputs && aggregate; i++) {
+    if (outputs[i].agg != AGG_NONE)
+      continue;
+    for (k=0; k<ngroups && groups[k]!=outputs[i].column; k++)
+      ;
+    if (k == ngroups) {
+      printf("%s is neither aggregated nor a -g column\n", outputs[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* the runs kept */
+  rows = malloc((store->header->nrows > 0 ? store->header->nrows : 1) * sizeof(uint64_t));
+  if (rows == NULL) {
+    printf("memory allocation for rows failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (row=0; row<store->header->nrows; row++) {
+    for (i=0; i<nconditions && holds(&conditions[i], row); i++)
+      ;
+    if (i == nconditions)
+      rows[nrows++] = row;
+  }
+
+  for (i=0; i<noutputs; i++)
+    printf(" %14s", outputs[i].text);
+  printf("\n");
+  if (!aggregate) {
+    for (j=0; j<nrows; j++) {
+      for (i=0; i<noutputs; i++)
+        print_cell(outputs[i].column, rows[j]);
+      printf("\n");
+    }
+  }
+  else if (nrows > 0) {
+    qsort(rows, nrows, sizeof(uint64_t), compare_rows);
+    for (first=0, j=1; j<=nrows; j++) {
+      for (i=0; j<nrows && i<ngroups && compare_cells(groups[i], rows[first], rows[j]) == 0; i++)
+        ;
+      if (j < nrows && i == ngroups)
+        continue;
+      print_group(rows + first, j - first, outputs, noutputs);
+      first = j;
+    }
+  }
+  free(rows);
+  results_close(store);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,433 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emulator.h"
+#include "simulator.h"
+#include "results.h"
+
+/* ******************************************************************
+   Columnar result store (see results.h).
+
+   The columns are described by fields[], each taken from a field of
+   struct sim_params or struct sim_stats.  Only parameters and counters
+   that mean something at the end of a run are kept: the trace level,
+   the trace file and the event list, medium and window depths are not.
+**********************************************************************/
+
+#define INITIAL_CAPACITY 64   /* rows of a new store */
+
+/* where a column comes from */
+#define IN_RUN    0           /* the protocol and congestion window setting */
+#define IN_PARAMS 1
+#define IN_STATS  2
+
+/* the C type of the field */
+#define C_TAG     0
+#define C_INT     1
+#define C_UINT    2
+#define C_LONG    3
+#define C_ULL     4
+#define C_FLOAT   5
+#define C_DOUBLE  6
+
+struct field {
+  const char *name;
+  int in;
+  int ctype;
+  size_t offset;
+};
+
+#define PARAM(f, c)     { #f, IN_PARAMS, c, offsetof(struct sim_params, f) }
+#define STAT(f, c)      { #f, IN_STATS, c, offsetof(struct sim_stats, f) }
+#define ESTIMATE(n, f)  { n, IN_STATS, C_DOUBLE, offsetof(struct sim_stats, f) }
+
+static const struct field fields[] = {
+  { "protocol", IN_RUN, C_TAG, 0 },
+  { "cc", IN_RUN, C_INT, 0 },
+  PARAM(seed, C_UINT),
+  PARAM(nsimmax, C_INT),
+  PARAM(lossprob, C_FLOAT),
+  PARAM(corruptprob, C_FLOAT),
+  PARAM(corruptdirection, C_INT),
+  PARAM(lambda, C_FLOAT),
+  PARAM(source, C_INT),
+  PARAM(on, C_FLOAT),
+  PARAM(off, C_FLOAT),
+  PARAM(nak, C_INT),
+  PARAM(fec, C_INT),
+  PARAM(warmup, C_FLOAT),
+  PARAM(precision, C_FLOAT),
+  PARAM(drain, C_FLOAT),
+  PARAM(rcvbuf, C_INT),
+  PARAM(streams, C_INT),
+  STAT(time, C_DOUBLE),
+  STAT(nevents, C_LONG),
+  STAT(tracehash, C_ULL),
+  STAT(nsim, C_INT),
+  STAT(window_full, C_INT),
+  STAT(total_ACKs_received, C_INT),
+  STAT(packets_resent, C_INT),
+  STAT(new_ACKs, C_INT),
+  STAT(packets_received, C_INT),
+  STAT(messages_delivered, C_INT),
+  STAT(ntolayer3, C_INT),
+  STAT(nlost, C_INT),
+  STAT(ncorrupt, C_INT),
+  STAT(fec_parity_sent, C_INT),
+  STAT(fec_repaired, C_INT),
+  STAT(messages_read, C_INT),
+  STAT(nbatches, C_INT),
+  ESTIMATE("goodput", estimate[0]),
+  ESTIMATE("goodput_hw", halfwidth[0]),
+  ESTIMATE("latency", estimate[1]),
+  ESTIMATE("latency_hw", halfwidth[1]),
+  ESTIMATE("resends", estimate[2]),
+  ESTIMATE("resends_hw", halfwidth[2]),
+};
+
+#define NFIELDS ((int)(sizeof(fields)/sizeof(fields[0])))
+
+static int column_type(const struct field *f)
+{
+  switch (f->ctype) {
+  case C_TAG:
+    return RESULTS_TAG;
+  case C_FLOAT:
+  case C_DOUBLE:
+    return RESULTS_REAL;
+  case C_ULL:
+    return RESULTS_UINT;
+  default:
+    return RESULTS_INT;
+  }
+}
+
+static size_t data_offset(uint32_t ncolumns)
+{
+  return sizeof(struct results_header) + ncolumns * sizeof(struct results_column);
+}
+
+/* the 8 byte cell of field f of a run */
+static void encode(const struct field *f, const char *protocol, const struct sim_params *params,
+                   int cc, const struct sim_stats *stats, char cell[8])
+{
+  const char *p = f->in == IN_PARAMS ? (const char *)params : (const char *)stats;
+  int64_t i = 0;
+  uint64_t u = 0;
+  double x = 0.0;
+
+  p += f->offset;
+  switch (f->ctype) {
+  case C_TAG:
+    memset(cell, 0, 8);
+    memcpy(cell, protocol, strnlen(protocol, 8));
+    return;
+  case C_INT:
+    i = f->in == IN_RUN ? cc : *(const int *)p;
+    break;
+  case C_UINT:
+    i = *(const unsigned int *)p;
+    break;
+  case C_LONG:
+    i = *(const long *)p;
+    break;
+  case C_ULL:
+    u = *(const unsigned long long *)p;
+    break;
+  case C_FLOAT:
+    x = *(const float *)p;
+    break;
+  default:
+    x = *(const double *)p;
+    break;
+  }
+  switch (column_type(f)) {
+  case RESULTS_INT:
+    memcpy(cell, &i, 8);
+    break;
+  case RESULTS_UINT:
+    memcpy(cell, &u, 8);
+    break;
+  default:
+    memcpy(cell, &x, 8);
+    break;
+  }
+}
+
+static int readall(int fd, void *buf, size_t size, off_t offset)
+{
+  return pread(fd, buf, size, offset) == (ssize_t)size ? 0 : -1;
+}
+
+static int writeall(int fd, const void *buf, size_t size, off_t offset)
+{
+  return pwrite(fd, buf, size, offset) == (ssize_t)size ? 0 : -1;
+}
+
+/* write the header and columns of an empty store */
+static int create(int fd, struct results_header *h)
+{
+  struct results_column c;
+  int k;
+
+  memset(h, 0, sizeof(*h));
+  h->magic = RESULTS_MAGIC;
+  h->version = RESULTS_VERSION;
+  h->ncolumns = NFIELDS;
+  h->capacity = INITIAL_CAPACITY;
+  if (ftruncate(fd, data_offset(NFIELDS) + NFIELDS * INITIAL_CAPACITY * 8) != 0 ||
+      writeall(fd, h, sizeof(*h), 0) != 0)
+    return -1;
+  for (k=0; k<NFIELDS; k++) {
+    memset(&c, 0, sizeof(c));
+    strncpy(c.name, fields[k].name, RESULTS_NAMELEN - 1);
+    c.type = column_type(&fields[k]);
+    if (writeall(fd, &c, sizeof(c), sizeof(*h) + k * sizeof(c)) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* is the store in fd one with fields[] as its columns? */
+static int check(int fd, const struct results_header *h)
+{
+  struct results_column c;
+  int k;
+
+  if (h->magic != RESULTS_MAGIC || h->version != RESULTS_VERSION ||
+      h->ncolumns != NFIELDS || h->nrows > h->capacity)
+    return -1;
+  for (k=0; k<NFIELDS; k++)
+    if (readall(fd, &c, sizeof(c), sizeof(*h) + k * sizeof(c)) != 0 ||
+        strncmp(c.name, fields[k].name, RESULTS_NAMELEN) != 0 ||
+        c.type != (uint32_t)column_type(&fields[k]))
+      return -1;
+  return 0;
+}
+
+/* double the capacity of the columns, moving the last one first: each
+   moves by at least the old capacity, so none overwrites another */
+static int grow(int fd, struct results_header *h)
+{
+  uint64_t capacity = 2 * h->capacity;
+  size_t size = h->nrows * 8;
+  char *column;
+  int k, status = 0;
+
+  column = malloc(size > 0 ? size : 1);
+  if (column == NULL)
+    return -1;
+  if (ftruncate(fd, data_offset(h->ncolumns) + h->ncolumns * capacity * 8) != 0)
+    status = -1;
+  for (k=h->ncolumns-1; k>0 && status==0; k--)
+    if (readall(fd, column, size, data_offset(h->ncolumns) + k * h->capacity * 8) != 0 ||
+        writeall(fd, column, size, data_offset(h->ncolumns) + k * capacity * 8) != 0)
+      status = -1;
+  free(column);
+  if (status == 0)
+    h->capacity = capacity;
+  return status;
+}
+
+/* append a run to the store in fd, which the caller has locked */
+static int append(int fd, const char *protocol, const struct sim_params *params,
+                  int congestion_control, const struct sim_stats *stats)
+{
+  struct results_header h;
+  struct stat st;
+  char cell[8];
+  int k;
+
+  if (fstat(fd, &st) != 0)
+    return -1;
+  if (st.st_size == 0) {
+    if (create(fd, &h) != 0)
+      return -1;
+  }
+  else if (readall(fd, &h, sizeof(h), 0) != 0 || check(fd, &h) != 0)
+    return -1;
+  if (h.nrows == h.capacity && grow(fd, &h) != 0)
+    return -1;
+
+  for (k=0; k<NFIELDS; k++) {
+    encode(&fields[k], protocol, params, congestion_control, stats, cell);
+    if (writeall(fd, cell, 8, data_offset(NFIELDS) + (k * h.capacity + h.nrows) * 8) != 0)
+      return -1;
+  }
+  /* the row only counts once all of its cells are written */
+  h.nrows++;
+  return writeall(fd, &h, sizeof(h), 0);
+}
+
+int results_append(const char *file, const char *protocol, const struct sim_params *params,
+                   int congestion_control, const struct sim_stats *stats)
+{
+  int fd, status = -1;
+
+  fd = open(file, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return -1;
+  if (flock(fd, LOCK_EX) == 0)
+    status = append(fd, protocol, params, congestion_control, stats);
+  close(fd);       /* releases the lock */
+  return status;
+}
+
+struct results *results_open(const char *file)
+{
+  struct results *r;
+  const struct results_header *h;
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if (flock(fd, LOCK_SH) != 0 || fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct results_header)) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  h = map;
+  if (h->magic != RESULTS_MAGIC || h->version != RESULTS_VERSION || h->nrows > h->capacity ||
+      data_offset(h->ncolumns) + h->ncolumns * h->capacity * 8 > (uint64_t)st.st_size) {
+    munmap(map, st.st_size);
+    close(fd);
+    return NULL;
+  }
+
+  r = malloc(sizeof(struct results));
+  if (r == NULL) {
+    printf("memory allocation for result store failed.");
+    exit(EXIT_FAILURE);
+  }
+  r->header = h;
+  r->columns = (const struct results_column *)(h + 1);
+  r->data = (const char *)map + data_offset(h->ncolumns);
+  r->size = st.st_size;
+  r->fd = fd;
+  return r;
+}
+
+int results_version(const char *file)
+{
+  struct results_header h;
+  int fd, version = -1;
+
+  fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  if (flock(fd, LOCK_SH) == 0 && readall(fd, &h, sizeof(h), 0) == 0 && h.magic == RESULTS_MAGIC)
+    version = h.version;
+  close(fd);
+  return version;
+}
+
+void results_close(struct results *r)
+{
+  munmap((void *)r->header, r->size);
+  close(r->fd);
+  free(r);
+}
+
+int results_find(const struct results *r, const char *name)
+{
+  uint32_t k;
+
+  for (k=0; k<r->header->ncolumns; k++)
+    if (strncmp(r->columns[k].name, name, RESULTS_NAMELEN) == 0)
+      return k;
+  return -1;
+}
+
+double results_value(const struct results *r, int column, uint64_t row)
+{
+  int64_t i;
+  uint64_t u;
+  double x;
+
+  switch (r->columns[column].type) {
+  case RESULTS_INT:
+    memcpy(&i, results_cell(r, column, row), 8);
+    return i;
+  case RESULTS_UINT:
+    memcpy(&u, results_cell(r, column, row), 8);
+    return u;
+  case RESULTS_REAL:
+    memcpy(&x, results_cell(r, column, row), 8);
+    return x;
+  default:
+    return 0.0;
+  }
+}
+
+void results_tag(const struct results *r, int column, uint64_t row, char tag[9])
+{
+  memcpy(tag, results_cell(r, column, row), 8);
+  tag[8] = '\0';
+}
+
+void results_run(const struct results *r, uint64_t row, char protocol[9], struct sim_params *params,
+                 int *congestion_control, struct sim_stats *stats)
+{
+  const struct field *f;
+  char *p;
+  int64_t i;
+  uint64_t u;
+  double x;
+  int k, column;
+
+  memset(protocol, 0, 9);
+  memset(params, 0, sizeof(*params));
+  memset(stats, 0, sizeof(*stats));
+  *congestion_control = 0;
+  for (k=0; k<NFIELDS; k++) {
+    f = &fields[k];
+    column = results_find(r, f->name);
+    if (column < 0 || r->columns[column].type != (uint32_t)column_type(f))
+      continue;
+    if (f->ctype == C_TAG) {
+      results_tag(r, column, row, protocol);
+      continue;
+    }
+    p = (f->in == IN_PARAMS ? (char *)params : (char *)stats) + f->offset;
+    memcpy(&i, results_cell(r, column, row), 8);
+    memcpy(&u, results_cell(r, column, row), 8);
+    memcpy(&x, results_cell(r, column, row), 8);
+    switch (f->ctype) {
+    case C_INT:
+      if (f->in == IN_RUN)
+        *congestion_control = i;
+      else
+        *(int *)p = i;
+      break;
+    case C_UINT:
+      *(unsigned int *)p = i;
+      break;
+    case C_LONG:
+      *(long *)p = i;
+      break;
+    case C_ULL:
+      *(unsigned long long *)p = u;
+      break;
+    case C_FLOAT:
+      *(float *)p = x;
+      break;
+    default:
+      *(double *)p = x;
+      break;
+    }
+  }
+}
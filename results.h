@@ -0,0 +1,93 @@
+/* ******************************************************************
+   Columnar result store: the parameters and statistics of many runs in
+   one compact binary file, to be filtered and aggregated (see query.c)
+   instead of scraping the printed statistics.
+
+   Every run is one row.  Its columns are the protocol, the congestion
+   window setting, the parameters of struct sim_params and the counters
+   and batch means estimates of struct sim_stats (see results.c for the
+   list).  Every cell is 8 bytes: an int64_t, a uint64_t (the trace
+   hash), a double or a tag of up to 8 characters, NUL padded.
+
+   File layout, in host byte order:
+     struct results_header
+     struct results_column    one per column
+     column 0: capacity cells, of which the first nrows are in use
+     column 1: capacity cells
+     ...
+   so that each column is a contiguous array in a memory-mapped file.
+   When the columns are full, appending a run doubles their capacity and
+   moves them apart.  Appends and readers lock the file (flock), so the
+   runs of a sweep can append to one store concurrently.
+
+   Include emulator.h and simulator.h first.
+**********************************************************************/
+#include <stdint.h>
+
+#define RESULTS_MAGIC   0x544c5352    /* "RSLT" */
+#define RESULTS_VERSION 3     /* 2: tracehash is a RESULTS_UINT column,
+                                 3: the streams column */
+
+/* column types */
+#define RESULTS_INT  0
+#define RESULTS_REAL 1
+#define RESULTS_TAG  2
+#define RESULTS_UINT 3
+
+#define RESULTS_NAMELEN 24
+
+struct results_header {
+  uint32_t magic, version;
+  uint32_t ncolumns, reserved;
+  uint64_t nrows;             /* rows in use */
+  uint64_t capacity;          /* cells allocated per column */
+};
+
+struct results_column {
+  char name[RESULTS_NAMELEN]; /* NUL terminated */
+  uint32_t type;              /* RESULTS_INT etc. */
+  uint32_t reserved;
+};
+
+/* append a run of protocol (e.g. "gbn") to the store in file, creating
+   it if it does not exist; return 0 on success, -1 on an I/O error or
+   if the file is not a store with this emulator's columns */
+extern int results_append(const char *file, const char *protocol, const struct sim_params *,
+                          int congestion_control, const struct sim_stats *);
+
+/* a store mapped for reading, which holds a shared lock on the file
+   (so appends wait) until it is closed */
+struct results {
+  const struct results_header *header;
+  const struct results_column *columns;
+  const char *data;           /* the first cell of column 0 */
+  size_t size;
+  int fd;
+};
+
+/* return NULL if the file is not a result store of RESULTS_VERSION */
+extern struct results *results_open(const char *file);
+
+/* the version of the result store in file, -1 if it is not one */
+extern int results_version(const char *file);
+extern void results_close(struct results *);
+
+/* the index of the named column, -1 if there is none */
+extern int results_find(const struct results *, const char *name);
+
+/* the cell of a column in a row */
+static inline const void *results_cell(const struct results *r, int column, uint64_t row)
+{
+  return r->data + ((uint64_t)column * r->header->capacity + row) * 8;
+}
+
+/* the value of a RESULTS_INT, RESULTS_UINT or RESULTS_REAL cell, 0.0 for
+   a tag */
+extern double results_value(const struct results *, int column, uint64_t row);
+
+/* the NUL terminated text of a RESULTS_TAG cell */
+extern void results_tag(const struct results *, int column, uint64_t row, char tag[9]);
+
+/* the run of a row; the columns the store lacks are left 0 */
+extern void results_run(const struct results *, uint64_t row, char protocol[9], struct sim_params *,
+                        int *congestion_control, struct sim_stats *);
@@ -0,0 +1,98 @@
+#include "rng.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* ******************************************************************
+   Seeding of the glibc-compatible generator, and the multi-lane
+   version of it (see rng.h).
+**********************************************************************/
+
+#define RNG_DISCARD (10 * RNG_DEGREE)   /* outputs dropped after seeding */
+
+void rng_seed(struct rng *g, unsigned int seed)
+{
+  int32_t word;
+  int32_t hi, lo;
+  int i;
+
+  if (seed == 0)
+    seed = 1;
+  g->state[0] = seed;
+  word = (int32_t)seed;
+  for (i=1; i<RNG_DEGREE; i++) {
+    /* word = (16807 * word) % 2147483647 without overflowing 31 bits */
+    hi = word / 127773;
+    lo = word % 127773;
+    word = 16807 * lo - 2836 * hi;
+    if (word < 0)
+      word += 2147483647;
+    g->state[i] = word;
+  }
+  g->front = RNG_SEP;
+  g->rear = 0;
+  for (i=0; i<RNG_DISCARD; i++)
+    rng_next(g);
+}
+
+void rng_lanes_seed(struct rng_lanes *g, const unsigned int seeds[RNG_LANES])
+{
+  struct rng lane;
+  int i, k;
+
+  for (i=0; i<RNG_LANES; i++) {
+    rng_seed(&lane, seeds[i]);
+    for (k=0; k<RNG_DEGREE; k++)
+      g->state[k][i] = lane.state[k];
+    /* every lane has taken the same number of steps */
+    g->front = lane.front;
+    g->rear = lane.rear;
+  }
+}
+
+static void fill_scalar(struct rng_lanes *g, uint32_t (*out)[RNG_LANES], int n)
+{
+  int i, j;
+
+  for (j=0; j<n; j++) {
+    for (i=0; i<RNG_LANES; i++) {
+      g->state[g->front][i] += g->state[g->rear][i];
+      out[j][i] = g->state[g->front][i] >> 1;
+    }
+    if (++g->front == RNG_DEGREE)
+      g->front = 0;
+    if (++g->rear == RNG_DEGREE)
+      g->rear = 0;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void fill_avx2(struct rng_lanes *g, uint32_t (*out)[RNG_LANES], int n)
+{
+  __m256i x;
+  int j;
+
+  for (j=0; j<n; j++) {
+    x = _mm256_add_epi32(_mm256_loadu_si256((__m256i *)g->state[g->front]),
+                         _mm256_loadu_si256((__m256i *)g->state[g->rear]));
+    _mm256_storeu_si256((__m256i *)g->state[g->front], x);
+    _mm256_storeu_si256((__m256i *)out[j], _mm256_srli_epi32(x, 1));
+    if (++g->front == RNG_DEGREE)
+      g->front = 0;
+    if (++g->rear == RNG_DEGREE)
+      g->rear = 0;
+  }
+}
+#endif
+
+void rng_lanes_fill(struct rng_lanes *g, uint32_t (*out)[RNG_LANES], int n)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx2")) {
+    fill_avx2(g, out, n);
+    return;
+  }
+#endif
+  fill_scalar(g, out, n);
+}
@@ -0,0 +1,58 @@
+/* ******************************************************************
+   Random number generator used by the emulator.
+
+   This is the additive feedback generator used by the GNU C library's
+   rand()/random() (x[i] = x[i-3] + x[i-31], seeded with a Park-Miller
+   sequence and 310 discarded outputs), so with the same seed it gives
+   exactly the same numbers as rand() on glibc systems.  Unlike rand()
+   its state is an ordinary struct, which can be saved in a checkpoint
+   and restored later.
+
+   struct rng_lanes runs RNG_LANES of these generators side by side, one
+   per replication of a Monte Carlo run (see montecarlo.c).  Its state is
+   kept in structure-of-arrays form, word k of every lane next to each
+   other, so that one step of all lanes is a single vector add; lane i
+   gives exactly the numbers of a struct rng seeded with the same seed.
+**********************************************************************/
+#include <stdint.h>
+
+#define RNG_DEGREE 31           /* words of generator state */
+#define RNG_SEP    3            /* distance between the front and rear pointers */
+#define RNG_MAX    2147483647   /* largest number returned by rng_next() */
+#define RNG_LANES  8            /* generators in a struct rng_lanes, one AVX2 vector */
+
+struct rng {
+  uint32_t state[RNG_DEGREE];
+  int front;                    /* index of x[i-3] */
+  int rear;                     /* index of x[i-31] */
+};
+
+/* seed the generator, as srand(seed) */
+extern void rng_seed(struct rng *, unsigned int seed);
+
+/* return the next number in [0,RNG_MAX], as rand() */
+static inline int rng_next(struct rng *g)
+{
+  uint32_t result;
+
+  g->state[g->front] += g->state[g->rear];
+  result = g->state[g->front] >> 1;
+  if (++g->front == RNG_DEGREE)
+    g->front = 0;
+  if (++g->rear == RNG_DEGREE)
+    g->rear = 0;
+  return (int)result;
+}
+
+struct rng_lanes {
+  uint32_t state[RNG_DEGREE][RNG_LANES];
+  int front;                    /* index of x[i-3], the same in every lane */
+  int rear;                     /* index of x[i-31] */
+};
+
+/* seed lane i as rng_seed(seeds[i]) */
+extern void rng_lanes_seed(struct rng_lanes *, const unsigned int seeds[RNG_LANES]);
+
+/* store the next n numbers of every lane in out, number j of lane i in
+   out[j][i]; uses AVX2 when the processor has it */
+extern void rng_lanes_fill(struct rng_lanes *, uint32_t (*out)[RNG_LANES], int n);
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "cwnd.h"
+#include "simulator.h"
+#include "sim.h"
+
+/* ******************************************************************
+   Simulation objects on top of the emulator's per-thread state (see
+   sim.h).
+
+   The state of the live simulation is in the emulator's variables;
+   every other simulation of the thread is kept in a checkpoint.  A
+   simulation is only swapped out when another one of the same thread
+   is run or created, so running one simulation in many small steps
+   costs nothing extra.
+**********************************************************************/
+
+struct sim {
+  struct checkpoint *cp;      /* the state while not live, else NULL */
+  int congestion_control;     /* not part of a checkpoint */
+  struct sim_stats stats;     /* as of the end of the last sim_run() */
+};
+
+static SIMLOCAL struct sim *live;   /* the simulation in the emulator's variables */
+
+/* make s the live simulation of this thread */
+static void swap_in(struct sim *s)
+{
+  if (live == s)
+    return;
+  if (live != NULL)
+    live->cp = checkpoint_save();
+  if (s->cp != NULL) {
+    checkpoint_restore(s->cp);
+    checkpoint_free(s->cp);
+    s->cp = NULL;
+  }
+  congestion_control = s->congestion_control;
+  live = s;
+}
+
+struct sim *sim_create(const struct sim_config *config)
+{
+  struct sim *s;
+
+  s = calloc(1, sizeof(struct sim));
+  if (s == NULL) {
+    printf("memory allocation for simulation failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->congestion_control = config->congestion_control;
+  swap_in(s);
+  init_params(&config->params);
+  A_init();
+  B_init();
+  get_statistics(&s->stats);
+  return s;
+}
+
+long sim_run(struct sim *s, long max_events)
+{
+  long n;
+
+  swap_in(s);
+  n = run_simulation(max_events);
+  get_statistics(&s->stats);
+  return n;
+}
+
+struct sim_stats sim_stats(struct sim *s)
+{
+  return s->stats;
+}
+
+void sim_destroy(struct sim *s)
+{
+  if (live == s) {
+    discard_events();     /* its events are the emulator's */
+    live = NULL;
+  }
+  if (s->cp != NULL)
+    checkpoint_free(s->cp);
+  free(s);
+}
@@ -0,0 +1,36 @@
+/* ******************************************************************
+   Embedding interface: simulations as objects.
+
+   Built as libsim_gbn.a/.so and libsim_sr.a/.so, together with the
+   rest of the emulator and one protocol, so that a program can run
+   many simulations in-process without reading stdin or parsing the
+   printed statistics.  Include emulator.h and simulator.h first.
+
+   The emulator keeps its state in per-thread variables, so only one
+   simulation per thread is live at a time; running another one swaps
+   the live one out into a checkpoint and the other one in (see
+   checkpoint_save()), which costs a copy of its event list.  A
+   simulation must only be used by the thread that created it.
+   Simulations only print with params.trace set, apart from the
+   emulator's warnings about a timer started twice or stopped while not
+   running, which always print.
+**********************************************************************/
+
+struct sim_config {
+  struct sim_params params;   /* parameters and seed of the run */
+  int congestion_control;     /* sender congestion window on or off */
+};
+
+struct sim;
+
+/* create a simulation at time 0; never returns NULL */
+extern struct sim *sim_create(const struct sim_config *);
+
+/* simulate at most max_events events (all of them if max_events < 0),
+   return the number of events simulated; 0 once the run has finished */
+extern long sim_run(struct sim *, long max_events);
+
+/* the statistics of the simulation so far */
+extern struct sim_stats sim_stats(struct sim *);
+
+extern void sim_destroy(struct sim *);
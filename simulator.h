@@ -0,0 +1,207 @@
+/* ******************************************************************
+   Simulator control interface.
+
+   emulator.h is the interface between the emulator and the protocol
+   (students') code.  This header is the interface used by programs that
+   drive the emulator themselves: the interactive main program, the
+   benchmark and test harnesses.  Protocol code should not include it.
+**********************************************************************/
+#include <stdint.h>
+
+/* parameters of a simulation run, normally read by init() from stdin */
+struct sim_params {
+  int nsimmax;            /* number of msgs to generate, then stop */
+  float lossprob;         /* probability that a packet is dropped */
+  float corruptprob;      /* probability that one bit is packet is flipped */
+  int corruptdirection;   /* A->B A<-B or bidirectional corruption/loss */
+  float lambda;           /* arrival rate of messages from layer 5 */
+  int trace;              /* TRACE level */
+  unsigned int seed;      /* random number generator seed */
+  int source;             /* traffic source at A's layer 5, see below */
+  float on, off;          /* mean on and off periods of SOURCE_ONOFF */
+  const char *tracefile;  /* arrival times of SOURCE_TRACE */
+  int nak;                /* nak_recovery of SR (see sr.c) */
+  int fec;                /* fec_group of GBN (see gbn.c) */
+  float warmup;           /* time before the batch means estimates start */
+  float precision;        /* stop once the estimates' 95% confidence intervals are
+                             within this fraction of their means, 0 to run to
+                             the end (see batchmeans.h) */
+  float drain;            /* time B's application takes to read a message, 0 to
+                             read every message at once (no flow control) */
+  int rcvbuf;             /* messages B's application buffers while it reads them
+                             (at least 1), advertised to A in B's ACKs */
+  int streams;            /* A and B draw from random number streams of their own,
+                             as pdes_run() needs, 0 for the single stream of the
+                             original emulator */
+};
+
+/* traffic sources: the time between messages is
+   SOURCE_UNIFORM    uniform on [0,2*lambda] (the original emulator's)
+   SOURCE_POISSON    exponential with mean lambda
+   SOURCE_CBR        always lambda
+   SOURCE_ONOFF      exponential with mean lambda during on periods, none
+                     during off periods; both periods are exponential,
+                     with means on and off
+   SOURCE_SATURATED  none: A is given a new message whenever its window
+                     has room, and a message it refuses is offered again
+                     later rather than counted in window_full
+   SOURCE_TRACE      the arrival times are read from tracefile, one per
+                     line in increasing order ('#' starts a comment) */
+#define SOURCE_UNIFORM   0
+#define SOURCE_POISSON   1
+#define SOURCE_CBR       2
+#define SOURCE_ONOFF     3
+#define SOURCE_SATURATED 4
+#define SOURCE_TRACE     5
+
+/* statistics of a simulation run */
+struct sim_stats {
+  double time;            /* simulation time */
+  long nevents;           /* number of events simulated */
+  unsigned long long tracehash; /* hash of every event simulated, in order */
+  int nsim;               /* number of messages from 5 to 4 */
+  int window_full;
+  int total_ACKs_received;
+  int packets_resent;
+  int new_ACKs;
+  int packets_received;
+  int messages_delivered;
+  int ntolayer3;          /* number sent into layer 3 */
+  int nlost;              /* number lost in media */
+  int ncorrupt;           /* number corrupted by media */
+  int nevlist;            /* number of events in the event list */
+  int ninflight;          /* number of packets in the medium */
+  int window_occupancy;   /* number of packets awaiting an ACK at A */
+  int fec_parity_sent;    /* number of parity packets sent by A */
+  int fec_repaired;       /* number of lost packets rebuilt from parity at B */
+  int nbatches;           /* batches of the estimates, if there is a precision */
+  double estimate[3];     /* goodput, latency and resends (BM_GOODPUT etc. of batchmeans.h) */
+  double halfwidth[3];    /* half-widths of their 95% confidence intervals */
+  int messages_read;      /* number read by B's application, with a drain time */
+};
+
+/* an entry of the event list, in increasing evtime order */
+struct event {
+  double evtime;          /* event time */
+  int evtype;             /* event type code */
+  int eventity;           /* entity where event occurs */
+  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  struct event *prev;
+  struct event *next;
+};
+
+extern SIMLOCAL struct event *evlist;   /* the event list */
+
+/* possible events: */
+#define  TIMER_INTERRUPT 0
+#define  FROM_LAYER5     1
+#define  FROM_LAYER3     2
+#define  LAYER5_READ     3   /* B's application reads a message from its buffer */
+
+/* return a double in range [0,1] */
+extern double jimsrand(void);
+
+/* insert an event into the event list */
+extern void insertevent(struct event *);
+
+/* initialize the simulator, reading the parameters from stdin */
+extern void init(void);
+
+/* initialize the simulator with the given parameters, discarding any
+   events left over from a previous run */
+extern void init_params(const struct sim_params *);
+
+/* free every event in the event list, ending the current run */
+extern void discard_events(void);
+
+/* random numbers in [0,RNG_MAX] read in place, next up to end; once
+   they are used up the emulator calls refill(), which must provide more */
+struct random_source {
+  const uint32_t *next, *end;
+  void (*refill)(struct random_source *);
+};
+
+/* take the random numbers from source instead of the emulator's own
+   generator, until called again with NULL (see montecarlo.c); the
+   source is not part of a checkpoint */
+extern void set_random_source(struct random_source *);
+
+/* change the parameters of the current run without resetting it, e.g. to
+   branch variants from a checkpoint (the seed is not used) */
+extern void update_params(const struct sim_params *);
+
+/* the parameters of the current run */
+extern void get_params(struct sim_params *);
+
+/* simulate at most maxevents events (all of them if maxevents < 0),
+   return the number of events simulated; 0 once the event list is empty */
+extern long run_simulation(long maxevents);
+
+/* simulate every event that occurs no later than endtime, return the
+   number of events simulated */
+extern long run_until(double endtime);
+
+extern void get_statistics(struct sim_stats *);
+extern void print_statistics(void);
+
+/* checkpoints of the complete simulation state (event list, clock, random
+   number generator, counters and protocol state), in memory or in a file.
+   A checkpoint can be restored any number of times to resume or branch
+   the simulation from the point it was taken. */
+struct checkpoint;
+
+extern struct checkpoint *checkpoint_save(void);
+extern void checkpoint_restore(const struct checkpoint *);
+extern void checkpoint_free(struct checkpoint *);
+
+/* return 0 on success, -1 on a write error */
+extern int checkpoint_write(const struct checkpoint *, FILE *);
+
+/* return NULL if the file is not a checkpoint of this emulator and protocol */
+extern struct checkpoint *checkpoint_read(FILE *);
+
+/* one run (an A/B pair with its own event list, random number generator
+   and protocol state) of pdes_run() or montecarlo_run() */
+struct flow {
+  struct sim_params params;   /* parameters, including the flow's own seed */
+  int congestion_control;     /* sender congestion window on or off */
+  struct sim_stats stats;     /* statistics at the end of the run */
+};
+
+/* simulate the flow as a conservative parallel simulation of two logical
+   processes, A and B, in two threads (see pdes.c); params.streams must
+   be set, and params.precision 0.  Return the number of time windows.
+   The results, trace hash included, are identical to a sequential run
+   with the same parameters. */
+extern long pdes_run(struct flow *flow);
+
+/* the logical processes of pdes_run(), each on a thread of its own.
+   lp_init() initializes the calling thread's emulator as entity A or B
+   alone: the packets it sends are kept for lp_take_sent() rather than
+   inserted, and the events it simulates (with run_until()) are kept for
+   lp_take_simulated() rather than hashed and freed.  The lists are in
+   increasing time order, linked by next. */
+extern void lp_init(const struct sim_params *, int entity);
+
+/* the time of the next event, DBL_MAX if there is none */
+extern double lp_next(void);
+
+extern struct event *lp_take_sent(void);
+extern struct event *lp_take_simulated(void);
+
+/* insert the packets sent by the other entity */
+extern void lp_receive(struct event *);
+
+/* fold the events simulated by A and B into the calling thread's trace
+   hash, in time order (A's first at the same time), and free them */
+extern void lp_hash(struct event *a, struct event *b);
+
+/* simulate the flows as Monte Carlo replications on the calling thread,
+   RNG_LANES at a time: their random numbers come from one multi-lane
+   generator (see rng.h), and each one runs for slice events at a time
+   before another may be swapped in from a checkpoint (see
+   montecarlo.c).  Return the number of swaps.  Each flow's results are
+   identical to a sequential run with the same parameters. */
+extern long montecarlo_run(struct flow *flows, int nflows, long slice);
+
+#define MONTECARLO_SLICE 16384L   /* default slice of montecarlo_run() */
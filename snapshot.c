@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <float.h>
+#include <time.h>
+#include "emulator.h"
+#include "simulator.h"
+#include "snapshot.h"
+
+/* ******************************************************************
+   Periodic statistics snapshots (see snapshot.h).
+**********************************************************************/
+
+SIMLOCAL long snapshot_next_event = LONG_MAX;
+SIMLOCAL double snapshot_next_time = DBL_MAX;
+
+static SIMLOCAL FILE *snapshot_out;
+static SIMLOCAL int snapshot_format;
+static SIMLOCAL long snapshot_events;        /* events between snapshots, 0 for none */
+static SIMLOCAL double snapshot_interval;    /* time units between snapshots, 0 for none */
+
+static SIMLOCAL struct sim_stats last;       /* statistics at the previous snapshot */
+static SIMLOCAL double last_wallclock;       /* wall-clock seconds at the previous snapshot */
+
+static double wallclock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void schedule(const struct sim_stats *stats)
+{
+  snapshot_next_event = LONG_MAX;
+  snapshot_next_time = DBL_MAX;
+  if (snapshot_events > 0)
+    snapshot_next_event = stats->nevents + snapshot_events;
+  if (snapshot_interval > 0.0)
+    snapshot_next_time = stats->time + snapshot_interval;
+}
+
+void snapshot_start(FILE *out, int format, long events, double interval)
+{
+  snapshot_out = out;
+  snapshot_format = format;
+  snapshot_events = events;
+  snapshot_interval = interval;
+
+  get_statistics(&last);
+  last_wallclock = wallclock();
+  schedule(&last);
+
+  if (snapshot_format == SNAPSHOT_CSV)
+    fprintf(snapshot_out, "time,events,messages,delivered,throughput,window,evlist,inflight,"
+            "resent,interval_resent,events_per_sec\n");
+}
+
+void snapshot_take(void)
+{
+  struct sim_stats stats;
+  double now, throughput, rate;
+
+  get_statistics(&stats);
+  now = wallclock();
+
+  /* messages delivered per time unit and events per wall-clock second since the last snapshot */
+  throughput = 0.0;
+  if (stats.time > last.time)
+    throughput = (stats.messages_delivered - last.messages_delivered) / (stats.time - last.time);
+  rate = 0.0;
+  if (now > last_wallclock)
+    rate = (stats.nevents - last.nevents) / (now - last_wallclock);
+
+  switch (snapshot_format) {
+  case SNAPSHOT_CSV:
+    fprintf(snapshot_out, "%f,%ld,%d,%d,%f,%d,%d,%d,%d,%d,%.0f\n",
+            stats.time, stats.nevents, stats.nsim, stats.messages_delivered, throughput,
+            stats.window_occupancy, stats.nevlist, stats.ninflight,
+            stats.packets_resent, stats.packets_resent - last.packets_resent, rate);
+    break;
+  case SNAPSHOT_JSON:
+    fprintf(snapshot_out, "{\"time\": %f, \"events\": %ld, \"messages\": %d, \"delivered\": %d, "
+            "\"throughput\": %f, \"window\": %d, \"evlist\": %d, \"inflight\": %d, "
+            "\"resent\": %d, \"interval_resent\": %d, \"events_per_sec\": %.0f}\n",
+            stats.time, stats.nevents, stats.nsim, stats.messages_delivered, throughput,
+            stats.window_occupancy, stats.nevlist, stats.ninflight,
+            stats.packets_resent, stats.packets_resent - last.packets_resent, rate);
+    break;
+  default:
+    fprintf(snapshot_out, "SNAPSHOT time %f: %ld events, %d msgs, %d delivered (%f/time unit), "
+            "window %d, evlist %d, in flight %d, resent %d (+%d), %.0f events/sec\n",
+            stats.time, stats.nevents, stats.nsim, stats.messages_delivered, throughput,
+            stats.window_occupancy, stats.nevlist, stats.ninflight,
+            stats.packets_resent, stats.packets_resent - last.packets_resent, rate);
+    break;
+  }
+
+  last = stats;
+  last_wallclock = now;
+  schedule(&stats);
+}
+
+void snapshot_finish(void)
+{
+  if (snapshot_out == NULL)
+    return;
+  snapshot_take();
+  fflush(snapshot_out);
+  snapshot_out = NULL;
+  snapshot_next_event = LONG_MAX;
+  snapshot_next_time = DBL_MAX;
+}
@@ -0,0 +1,32 @@
+/* ******************************************************************
+   Periodic statistics snapshots of a running simulation.
+
+   After snapshot_start() the emulator calls snapshot_take() every
+   `events` simulated events and/or every `interval` time units.  Each
+   snapshot reports the interval throughput, the window occupancy at
+   A, the event list depth, packets in the medium, retransmissions and
+   the wall-clock event rate, as text, CSV or one JSON object per line.
+
+   When snapshots are disabled the emulator's only cost is comparing
+   the event count and the clock against snapshot_next_event and
+   snapshot_next_time once per event.
+**********************************************************************/
+#include <stdio.h>
+
+#define SNAPSHOT_TEXT 0
+#define SNAPSHOT_CSV  1
+#define SNAPSHOT_JSON 2
+
+/* event count and time of the next snapshot, never if not started */
+extern SIMLOCAL long snapshot_next_event;
+extern SIMLOCAL double snapshot_next_time;
+
+/* take snapshots every events events (0 for never) and every interval
+   time units (0.0 for never), writing them to out in the given format */
+extern void snapshot_start(FILE *out, int format, long events, double interval);
+
+/* write a snapshot and schedule the next one */
+extern void snapshot_take(void);
+
+/* write a final snapshot and stop taking snapshots */
+extern void snapshot_finish(void);
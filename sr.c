@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include "emulator.h"
 #include "sr.h"
+#include "cwnd.h"
 
 /* ******************************************************************
 Go Back N protocol.  Adapted from J.F.Kurose
@@ -20,13 +21,28 @@ Modifications:
 - removed bidirectional GBN code and other code not used by prac.
 - fixed C style to adhere to current programming style
 - added GBN implementation
+- added optional AIMD congestion window (see cwnd.h), grown by the packets
+the window slides past; ACKs beyond the oldest unACKed packet are its
+duplicate ACKs
+- B ACKs every packet it receives, also duplicates of the previous window
+- optional NAKs (nak_recovery): B NAKs every gap below a packet it
+receives once, and A resends a NAKed packet at once rather than when
+its timer goes off
+- optional flow control (flow_control): B only takes the packets its
+application will have room for, and its ACKs advertise that room in
+payload[1], counted from B_base in payload[2].  A sends a new packet
+only within the room, or when it has nothing awaiting an ACK, so that
+its timer keeps probing B while the room is 0
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
                         MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
+#define SEQSPACE 12     /* the min sequence space for SR must be at least 2 * windowsize */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define NAK (-2)        /* seqnum of a NAK from B, whose acknum is the missing packet */
+
+const char protocol_name[] = "sr";
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
 the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
@@ -55,20 +71,40 @@ bool IsCorrupted(struct pkt packet)
 }
 /********* Sender (A) variables and functions for Selective Repeat ************/
 
-static struct pkt buffer[WINDOWSIZE]; /* create buffer for all potential packets that may occur in the sender's window*/
-static bool acked[WINDOWSIZE]; /*track the status of each packet */
-static int windowcount;
-static int A_left = 0; /*the left most or the base or the window*/
-static int A_nextseqnum = 0; /*next sequence number to use*/
-static int timer_sequence;
-static int timer[WINDOWSIZE];
+static SIMLOCAL struct pkt buffer[WINDOWSIZE]; /* create buffer for all potential packets that may occur in the sender's window*/
+static SIMLOCAL bool acked[WINDOWSIZE]; /*track the status of each packet */
+static SIMLOCAL int windowcount; /*number of packets sent but not yet slid out of the window*/
+static SIMLOCAL int A_left = 0; /*the left most or the base or the window*/
+static SIMLOCAL int A_nextseqnum = 0; /*next sequence number to use*/
+static SIMLOCAL struct cwnd A_cwnd; /*congestion window, used if congestion_control is set*/
+static SIMLOCAL int A_rwnd; /*flow control: the room B last advertised...*/
+static SIMLOCAL int A_rbase; /*...from this sequence number on*/
+
+/*the number of packets the sender may have awaiting an ACK*/
+static int A_windowsize(void) {
+    if (congestion_control)
+        return cwnd_window(&A_cwnd);
+    return WINDOWSIZE;
+}
+
+/*flow control: may the next new packet go out?*/
+static bool A_rwndopen(void) {
+    if (!flow_control || windowcount == 0)
+        return true;
+    return (A_nextseqnum - A_rbase + SEQSPACE) % SEQSPACE < A_rwnd;
+}
+
+/*is seqnum one of the packets currently in the sender's window?*/
+static bool A_inwindow(int seqnum) {
+    return seqnum >= 0 && (seqnum - A_left + SEQSPACE) % SEQSPACE < windowcount;
+}
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
 void A_output(struct msg message) {
     int i;
     struct pkt sendpkt;
     /* if not blocked waiting on ACK */
-    if (windowcount < WINDOWSIZE) {  /*Check whether the window is full*/
+    if (windowcount < A_windowsize() && A_rwndopen()) {  /*Check whether the window is full*/
         if (TRACE > 1) printf("----A: New message arrives, send window is not full, send new message to layer3!\n");
         /*Create packet*/
         sendpkt.seqnum = A_nextseqnum;
@@ -79,17 +115,17 @@ void A_output(struct msg message) {
         /*store new packets in sender's buffer at its seqnum --> allows SR if errors occur*/
         buffer[A_nextseqnum % WINDOWSIZE] = sendpkt; /*Wrapped by WINDOWSIZE*/
         acked[A_nextseqnum % WINDOWSIZE] = false; /* marked as unACKed --> used for tracking*/
+        windowcount++;
+        window_occupancy = windowcount;
 
-        if (TRACE > 0);
+        if (TRACE > 0)
             printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
         /*Transmit to B*/
         tolayer3(A, sendpkt);
 
         /*Start timer if first packet in the window*/
-        if (windowcount == 1){
+        if (windowcount == 1)
             starttimer(A, RTT);
-            timer_sequence = sendpkt.seqnum;
-        }
         /*Move to the next packet, +1 sequence number*/
         A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE; /*Wrapping back to 0*/
     } else {
@@ -99,95 +135,96 @@ void A_output(struct msg message) {
     }
 }
 /* called from layer 3, when a packet arrives for layer 4
-   In this practical this will always be an ACK as B never sends data.
+   In this practical this will always be an ACK (or, with nak_recovery,
+   a NAK) as B never sends data.
 */
 void A_input(struct pkt packet) {
-    int i;
-    int index;
-    int sequence;
-    int window_end = (A_left + WINDOWSIZE - 1) % SEQSPACE;
-    bool IsInWindow;
     int acknum = packet.acknum;
-    index = acknum % WINDOWSIZE;
+    int index, slid;
+    bool rwnd_changed = false;
 
     /* if received ACK is not corrupted */
-    if (!IsCorrupted(packet)) {
+    if (IsCorrupted(packet)) {
         if (TRACE > 0)
-            printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
-        total_ACKs_received++;
-        /*Check whether the ACK is new in the sender's window*/
+            printf("----A: corrupted ACK is received, do nothing!\n");
+        return;
+    }
+    total_ACKs_received++;
 
-        if (TRACE > 0)
-            printf("----A: ACK %d is not a duplicate\n", acknum);
-        total_ACKs_received++;
-
-        if (A_left <= window_end){
-            IsInWindow = (acknum >= A_left && acknum <= window_end);
-        } else{
-            /*Wrap around SEQSPACE*/
-            IsInWindow = (acknum >=  A_left || acknum <= window_end);
-        }     
-
-        if (!IsInWindow){
-            if (TRACE > 0) printf("----A: ACK %d outside current window, do nothing!\n", acknum);
-            return;
-        }
-            new_ACKs++;
+    /*every ACK and NAK advertises the room B has*/
+    if (flow_control) {
+        rwnd_changed = A_rwnd != packet.payload[1] || A_rbase != packet.payload[2];
+        A_rwnd = packet.payload[1];
+        A_rbase = packet.payload[2];
+    }
 
-        /* slide window by the number of packets ACKed */
-        if (acked[index]){
-            if (TRACE > 0) printf("----A: corrupted ACK is received, do nothing!\n");
-            return;
+    /*NAK: B saw a gap at acknum, resend it without waiting for the timer*/
+    if (packet.seqnum == NAK) {
+        index = acknum % WINDOWSIZE;
+        if (A_inwindow(acknum) && !acked[index]) {
+            if (TRACE > 0) printf("----A: NAK %d is received, resending packet %d\n", acknum, acknum);
+            tolayer3(A, buffer[index]);
+            packets_resent++;
         }
+        return;
+    }
+
+    if (TRACE > 0)
+        printf("----A: uncorrupted ACK %d is received\n", acknum);
+    index = acknum % WINDOWSIZE;
+
+    /*Check whether the ACK is new in the sender's window: re-ACKs of older
+      packets and B's window updates say nothing about the oldest unACKed one*/
+    if (!A_inwindow(acknum) || acked[index]) {
         if (TRACE > 0)
             printf("----A: duplicate ACK received, do nothing!\n");
+        return;
+    }
 
-        new_ACKs++;
-        acked[index] = true;
-        stoptimer(A);
-
-        if (acknum == A_left){
-            while (acked[A_left % WINDOWSIZE]){
-                acked[A_left % WINDOWSIZE] = false;
-                A_left = (A_left + 1) % SEQSPACE;
-                windowcount--;
-                if (windowcount == 0) break;
-            }
-        }
-        if (windowcount > 0) {
-            for (i = 0; i < WINDOWSIZE; i++){
-                sequence = (A_left + i) % SEQSPACE;
-                if (sequence == A_nextseqnum)
-                    break;
-                index = sequence % WINDOWSIZE;
-                if (!acked[index]){
-                    starttimer(A, RTT);
-                    break;
-                }
-            }
+    if (TRACE > 0)
+        printf("----A: ACK %d is not a duplicate\n", acknum);
+    new_ACKs++;
+    acked[index] = true;
+
+    /*an ACK beyond the oldest unACKed packet leaves the window where it is:
+      it counts as a duplicate ACK of that packet, unless it changed the room
+      B advertises.  Third one: resend it without waiting for the timer*/
+    if (acknum != A_left) {
+        if (congestion_control && !rwnd_changed && cwnd_dupack(&A_cwnd)) {
+            if (TRACE > 0) printf("----A: third duplicate ACK, resending packet %d\n", buffer[A_left % WINDOWSIZE].seqnum);
+            tolayer3(A, buffer[A_left % WINDOWSIZE]);
+            packets_resent++;
         }
+        return;
+    }
+
+    /* slide window past every ACKed packet at its base */
+    for (slid = 0; windowcount > 0 && acked[A_left % WINDOWSIZE]; slid++) {
+        A_left = (A_left + 1) % SEQSPACE;
+        windowcount--;
     }
+    window_occupancy = windowcount;
+    if (congestion_control)
+        cwnd_newack(&A_cwnd, slid);
+
+    /*the timer covers the oldest unACKed packet*/
+    stoptimer(A);
+    if (windowcount > 0)
+        starttimer(A, RTT);
 }
 
 /* called when A's timer goes off */
 void A_timerinterrupt(void) {
-    int i;
-    int index;
-
     if (TRACE > 0)
         printf("----A: time out, resend packets!\n");
-    if (windowcount > 0){
-        for (i = 0; i < WINDOWSIZE; i++){
-            index = (A_left + i) % SEQSPACE % WINDOWSIZE;
-            if (!acked[index] && (A_left + 1) % SEQSPACE != A_nextseqnum){
-                if (TRACE > 0) printf("----A: resending packet %d\n", buffer[index].seqnum);
-
-            tolayer3(A, buffer[index]);
-            packets_resent++;
-            starttimer(A, RTT);
-            break;
-            }
-        }
+    if (congestion_control)
+        cwnd_timeout(&A_cwnd);
+    if (windowcount > 0) {
+        /*the oldest packet is always unACKed, or the window would have slid past it*/
+        if (TRACE > 0) printf("----A: resending packet %d\n", buffer[A_left % WINDOWSIZE].seqnum);
+        tolayer3(A, buffer[A_left % WINDOWSIZE]);
+        packets_resent++;
+        starttimer(A, RTT);
     }
 }
 /* the following routine will be called once (only) before any other */
@@ -197,70 +234,181 @@ void A_init(void) {
     A_left = 0;
     A_nextseqnum = 0; /*A starts with 0*/
     windowcount = 0;
-    for (i = 0; i < WINDOWSIZE; i++){
+    window_occupancy = 0;
+    for (i = 0; i < WINDOWSIZE; i++)
         acked[i] = true;
-        timer[i] = NOTINUSE;
-    }
+    cwnd_init(&A_cwnd, WINDOWSIZE);
+    A_rwnd = WINDOWSIZE;
+    A_rbase = 0;
 }
 
 /********* Receiver (B) variables and procedures for Selective Repeat ************/
 
-static int B_expectedseqnum;
-static int B_nextseqnum;
-static int B_base;
-static struct pkt B_buffer[WINDOWSIZE];
-static bool received[WINDOWSIZE];
+static SIMLOCAL int B_base;
+static SIMLOCAL struct pkt B_buffer[WINDOWSIZE];
+static SIMLOCAL bool received[WINDOWSIZE];
+static SIMLOCAL bool naked[WINDOWSIZE]; /*a NAK has been sent for this gap*/
 
-void B_input(struct pkt packet) {
+/*the packets from B_base on that B takes: with flow control, no more than its application has room for*/
+static int B_window(void) {
+    if (flow_control && tolayer5_room(B) < WINDOWSIZE)
+        return tolayer5_room(B);
+    return WINDOWSIZE;
+}
+
+/*send an ACK, or a NAK if seqnum is NAK, for acknum to A*/
+static void B_sendack(int seqnum, int acknum) {
     struct pkt sendpkt;
     int i;
+
+    sendpkt.seqnum = seqnum;
+    sendpkt.acknum = acknum;
+    /* we don't have any data to send.  fill payload with 0's */
+    for (i = 0; i < 20; i++)
+        sendpkt.payload[i] = '0';
+    /*flow control: advertise the room of the receiving application*/
+    if (flow_control) {
+        sendpkt.payload[1] = B_window();
+        sendpkt.payload[2] = B_base;
+    }
+    sendpkt.checksum = ComputeChecksum(sendpkt);
+    tolayer3(B, sendpkt);
+}
+
+void B_input(struct pkt packet) {
+    int i;
     int window_index;
-    
-    int B_sequence = packet.seqnum;
+
+    if (IsCorrupted(packet)) {
+        if (TRACE > 0) printf("----B: packet corrupted, do nothing!\n");
+        return;
+    }
+
     /*Calculate the window position*/
-    window_index = (B_sequence - B_base + SEQSPACE) % SEQSPACE;
-
-    if (!IsCorrupted(packet)) {
-        if (TRACE > 0) printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++; /*Increase  packet received*/
-        
-    if (window_index < WINDOWSIZE){
-        if (!received[window_index]){
-            B_buffer[window_index] = packet;
-            received[window_index] = true;
-
-            if (window_full == 0){
-                while (received[0]){
-                    tolayer5(B, B_buffer[0].payload);
-
-                    /*Slide window and shift packet fwd*/
-                    for (i = 0; i < WINDOWSIZE - 1; i++){
-                        received[i] = received[i + 1];
-                        B_buffer[i] = B_buffer[i+1];
-                    }
-                    /*Change the state of the last window*/
-                    received[WINDOWSIZE - 1] = false;
-
-                    /*Move the slide forward the seqspace*/
-                    B_base = (B_base + 1) % SEQSPACE;
-                    }
-                }
+    window_index = (packet.seqnum - B_base + SEQSPACE) % SEQSPACE;
+
+    if (window_index >= WINDOWSIZE) {
+        /*a packet of the previous window, whose ACK must have been lost: ACK it again*/
+        if (TRACE > 0) printf("----B: packet %d is a duplicate, resend ACK!\n", packet.seqnum);
+        B_sendack(NOTINUSE, packet.seqnum);
+        return;
+    }
+
+    if (window_index >= B_window()) {
+        /*no room for it in the application: tell A how much room there is*/
+        if (TRACE > 0) printf("----B: no room for packet %d, send window update!\n", packet.seqnum);
+        B_sendack(NOTINUSE, (B_base + SEQSPACE - 1) % SEQSPACE);
+        return;
+    }
+
+    if (TRACE > 0) printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
+    B_sendack(NOTINUSE, packet.seqnum);
+    if (!received[window_index]) {
+        packets_received++; /*Increase  packet received*/
+        B_buffer[window_index] = packet;
+        received[window_index] = true;
+    }
+
+    /*every packet missing before this one is a gap: NAK it once*/
+    if (nak_recovery) {
+        for (i = 0; i < window_index; i++) {
+            if (!received[i] && !naked[i]) {
+                if (TRACE > 0) printf("----B: packet %d is missing, send NAK!\n", (B_base + i) % SEQSPACE);
+                B_sendack(NAK, (B_base + i) % SEQSPACE);
+                naked[i] = true;
             }
         }
     }
+
+    while (received[0]) {
+        tolayer5(B, B_buffer[0].payload);
+
+        /*Slide window and shift packet fwd*/
+        for (i = 0; i < WINDOWSIZE - 1; i++) {
+            received[i] = received[i + 1];
+            naked[i] = naked[i + 1];
+            B_buffer[i] = B_buffer[i + 1];
+        }
+        /*Change the state of the last window*/
+        received[WINDOWSIZE - 1] = false;
+        naked[WINDOWSIZE - 1] = false;
+
+        /*Move the slide forward the seqspace*/
+        B_base = (B_base + 1) % SEQSPACE;
+    }
 }
 
 void B_init(void) {
     int i; 
-    B_expectedseqnum = 0;
-    B_nextseqnum = 1;
     B_base = 0;
 
     for (i = 0; i < WINDOWSIZE; i++){
-        received[i] =false;
+        received[i] = false;
+        naked[i] = false;
     }
 
 }
 
 void B_output(struct msg message) {}
 void B_timerinterrupt(void) {}
+
+/********* Checkpointing: the complete state of both entities ************/
+
+struct sr_state {
+    struct pkt buffer[WINDOWSIZE];
+    bool acked[WINDOWSIZE];
+    int windowcount;
+    int A_left;
+    int A_nextseqnum;
+    struct cwnd A_cwnd;
+    int A_rwnd;
+    int A_rbase;
+    int B_base;
+    struct pkt B_buffer[WINDOWSIZE];
+    bool received[WINDOWSIZE];
+    bool naked[WINDOWSIZE];
+};
+
+size_t protocol_state_size(void) {
+    return sizeof(struct sr_state);
+}
+
+void protocol_save_state(void *data) {
+    struct sr_state *state = data;
+    int i;
+
+    for (i = 0; i < WINDOWSIZE; i++){
+        state->buffer[i] = buffer[i];
+        state->acked[i] = acked[i];
+        state->B_buffer[i] = B_buffer[i];
+        state->received[i] = received[i];
+        state->naked[i] = naked[i];
+    }
+    state->windowcount = windowcount;
+    state->A_left = A_left;
+    state->A_nextseqnum = A_nextseqnum;
+    state->A_cwnd = A_cwnd;
+    state->A_rwnd = A_rwnd;
+    state->A_rbase = A_rbase;
+    state->B_base = B_base;
+}
+
+void protocol_restore_state(const void *data) {
+    const struct sr_state *state = data;
+    int i;
+
+    for (i = 0; i < WINDOWSIZE; i++){
+        buffer[i] = state->buffer[i];
+        acked[i] = state->acked[i];
+        B_buffer[i] = state->B_buffer[i];
+        received[i] = state->received[i];
+        naked[i] = state->naked[i];
+    }
+    windowcount = state->windowcount;
+    A_left = state->A_left;
+    A_nextseqnum = state->A_nextseqnum;
+    A_cwnd = state->A_cwnd;
+    A_rwnd = state->A_rwnd;
+    A_rbase = state->A_rbase;
+    B_base = state->B_base;
+}
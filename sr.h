@@ -9,3 +9,12 @@ void B_init(void);
 void B_input(struct pkt);
 extern void B_output(struct msg);
 extern void B_timerinterrupt(void);
+
+
+/* checkpointing of the protocol state (see simulator.h) */
+extern size_t protocol_state_size(void);
+extern void protocol_save_state(void *);
+extern void protocol_restore_state(const void *);
+
+/* the protocol's name, e.g. in result stores (see results.h) */
+extern const char protocol_name[];
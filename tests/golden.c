@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../emulator.h"
+#include "../gbn.h"
+#include "../cwnd.h"
+#include "../simulator.h"
+#include "../sim.h"
+#include "../results.h"
+
+/* ******************************************************************
+   Golden output harness.
+
+   Runs the protocol it is linked with over a fixed matrix of seeds and
+   simulation parameters, and compares the trace hash of every run (a
+   hash over every simulated event, see emulator.c) and its final
+   counters against a file of recorded golden runs.  Any change to the
+   event list, random number generator or allocator that does not
+   change the simulation must leave every line identical.
+
+   Every run is repeated with a checkpoint taken halfway through, written
+   to a temporary file, read back and resumed, which must give the same
+   line as the uninterrupted run.  Finally the whole matrix is run again
+   as Monte Carlo replications (see montecarlo.c) and as simulation
+   objects run in turn (see sim.h), and the runs with streams as
+   parallel simulations of A and B (see pdes.c), each of which must also
+   give the same line as its sequential run.
+   The runs of the simulation objects are also appended to a result
+   store (see results.h), and every run read back from it must give the
+   same line again.
+
+   The trace-driven runs read tests/trace.txt, so run the harness from
+   the top directory, as make check does.
+
+   usage: golden [-u] goldenfile
+   -u  record the runs in goldenfile instead of comparing
+**********************************************************************/
+
+#define MAXLINE 512
+
+static const unsigned int seeds[] = { 1, 9999, 31337 };
+
+/* nsimmax, lossprob, corruptprob, corruptdirection, lambda, trace, seed,
+   source, on, off, tracefile, nak, fec, warmup, precision, drain, rcvbuf,
+   streams */
+static const struct sim_params matrix[] = {
+  { 1000, 0.0, 0.0, 0, 50.0, 0, 0 },
+  { 1000, 0.1, 0.1, 2, 50.0, 0, 0 },
+  { 1000, 0.2, 0.2, 0, 20.0, 0, 0 },
+  {  500, 0.3, 0.0, 1, 10.0, 0, 0 },
+  { 2000, 0.05, 0.3, 2, 30.0, 0, 0 },
+  { 1000, 0.1, 0.1, 2, 50.0, 0, 0, SOURCE_POISSON },
+  { 1000, 0.1, 0.0, 0, 40.0, 0, 0, SOURCE_CBR },
+  { 1000, 0.1, 0.1, 2, 20.0, 0, 0, SOURCE_ONOFF, 200.0, 400.0 },
+  {   50, 0.1, 0.1, 2, 0.0, 0, 0, SOURCE_SATURATED },
+  { 1000, 0.1, 0.1, 2, 0.0, 0, 0, SOURCE_TRACE, 0.0, 0.0, "tests/trace.txt" },
+  { 1000, 0.1, 0.1, 2, 50.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 1 },
+  { 1000, 0.2, 0.2, 0, 20.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 1 },
+  { 1000, 0.1, 0.1, 2, 50.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 0, 3 },
+  { 1000, 0.2, 0.2, 2, 30.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 0, 2 },
+  { 100000, 0.1, 0.1, 2, 50.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 0, 0, 1000.0, 0.05 },
+  { 1000, 0.1, 0.1, 2, 10.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 0, 0, 0.0, 0.0, 15.0, 3 },
+  { 1000, 0.1, 0.1, 2, 50.0, 0, 0, SOURCE_UNIFORM, 0.0, 0.0, NULL, 0, 0, 0.0, 0.0, 0.0, 0, 1 },
+  { 1000, 0.2, 0.2, 2, 10.0, 0, 0, SOURCE_POISSON, 0.0, 0.0, NULL, 0, 0, 0.0, 0.0, 15.0, 3, 1 },
+};
+
+#define NRUNS (sizeof(seeds)/sizeof(seeds[0]) * sizeof(matrix)/sizeof(matrix[0]) * 2)
+
+/* whether the protocol implements the options of a row: NAKs are SR's
+   and parity packets GBN's */
+static int applies(const struct sim_params *params)
+{
+  return (!params->nak || strcmp(protocol_name, "sr") == 0) &&
+         (params->fec <= 0 || strcmp(protocol_name, "gbn") == 0);
+}
+
+/* describe a finished run as a single line */
+static void describe_stats(const struct sim_params *params, int cc, const struct sim_stats *s, char *line)
+{
+  char source[32] = "";
+  char nak[16] = "";
+  char fec[16] = "", repaired[48] = "";
+  char precision[32] = "", estimates[160] = "";
+  char drain[32] = "", read[16] = "";
+  char streams[16] = "";
+
+  /* the original uniform source is left out, as in the first recorded runs */
+  if (params->source != SOURCE_UNIFORM)
+    snprintf(source, sizeof(source), " source %d", params->source);
+  if (params->nak)
+    snprintf(nak, sizeof(nak), " nak %d", params->nak);
+  if (params->fec) {
+    snprintf(fec, sizeof(fec), " fec %d", params->fec);
+    snprintf(repaired, sizeof(repaired), " parity %d repaired %d", s->fec_parity_sent, s->fec_repaired);
+  }
+  if (params->precision > 0.0) {
+    snprintf(precision, sizeof(precision), " warmup %.1f precision %.2f", params->warmup, params->precision);
+    snprintf(estimates, sizeof(estimates), " batches %d goodput %.6f+-%.6f latency %.6f+-%.6f resends %.6f+-%.6f",
+             s->nbatches, s->estimate[0], s->halfwidth[0], s->estimate[1], s->halfwidth[1],
+             s->estimate[2], s->halfwidth[2]);
+  }
+  if (params->drain > 0.0) {
+    snprintf(drain, sizeof(drain), " drain %.1f rcvbuf %d", params->drain, params->rcvbuf);
+    snprintf(read, sizeof(read), " read %d", s->messages_read);
+  }
+  if (params->streams)
+    snprintf(streams, sizeof(streams), " streams %d", params->streams);
+  snprintf(line, MAXLINE,
+           "seed %u nsim %d loss %.2f corrupt %.2f dir %d lambda %.1f%s%s%s%s%s%s cc %d"
+           " : hash %016llx events %ld delivered %d resent %d new_ACKs %d window_full %d%s%s%s\n",
+           params->seed, params->nsimmax, params->lossprob, params->corruptprob,
+           params->corruptdirection, params->lambda, source, nak, fec, precision, drain, streams, cc,
+           s->tracehash, s->nevents, s->messages_delivered,
+           s->packets_resent, s->new_ACKs, s->window_full, repaired, estimates, read);
+}
+
+static void describe(const struct sim_params *params, int cc, char *line)
+{
+  struct sim_stats stats;
+
+  get_statistics(&stats);
+  describe_stats(params, cc, &stats, line);
+}
+
+static void start(const struct sim_params *params, int cc)
+{
+  congestion_control = cc;
+  init_params(params);
+  A_init();
+  B_init();
+}
+
+/* run one simulation, return its number of events */
+static long run(const struct sim_params *params, int cc, char *line)
+{
+  struct sim_stats stats;
+
+  start(params, cc);
+  run_simulation(-1);
+  describe(params, cc, line);
+  get_statistics(&stats);
+  return stats.nevents;
+}
+
+/* run one simulation, checkpointing it to a file after nevents events
+   and resuming it from the file */
+static void run_checkpointed(const struct sim_params *params, int cc, long nevents, char *line)
+{
+  struct checkpoint *cp;
+  FILE *fp;
+
+  start(params, cc);
+  run_simulation(nevents);
+  cp = checkpoint_save();
+  fp = tmpfile();
+  if (fp == NULL || checkpoint_write(cp, fp) != 0) {
+    printf("unable to write checkpoint\n");
+    exit(EXIT_FAILURE);
+  }
+  checkpoint_free(cp);
+
+  /* start over, so that nothing of the first half survives but the file */
+  start(params, cc);
+  rewind(fp);
+  cp = checkpoint_read(fp);
+  fclose(fp);
+  if (cp == NULL) {
+    printf("unable to read checkpoint\n");
+    exit(EXIT_FAILURE);
+  }
+  checkpoint_restore(cp);
+  checkpoint_free(cp);
+  run_simulation(-1);
+  describe(params, cc, line);
+}
+
+int main(int argc, char **argv)
+{
+  struct sim_params params;
+  char line[MAXLINE], golden[MAXLINE], resumed[MAXLINE];
+  static char lines[NRUNS][MAXLINE];
+  struct flow flows[NRUNS];
+  struct sim *sims[NRUNS];
+  struct sim_config config;
+  struct sim_stats stats;
+  struct results *store;
+  char storefile[] = "/tmp/goldenXXXXXX", protocol[9];
+  int running, storefd;
+  FILE *fp;
+  int update = 0;
+  int nruns = 0, nfailed = 0;
+  size_t i, j;
+  long nevents;
+  int cc, k, opt;
+
+  while ((opt = getopt(argc, argv, "u")) != -1) {
+    switch (opt) {
+    case 'u':
+      update = 1;
+      break;
+    default:
+      printf("usage: %s [-u] goldenfile\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind != argc - 1) {
+    printf("usage: %s [-u] goldenfile\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  fp = fopen(argv[optind], update ? "w" : "r");
+  if (fp == NULL) {
+    printf("unable to open golden file %s\n", argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+
+  for (i=0; i<sizeof(seeds)/sizeof(seeds[0]); i++)
+    for (j=0; j<sizeof(matrix)/sizeof(matrix[0]); j++)
+      for (cc=0; cc<=1 && applies(&matrix[j]); cc++) {
+        params = matrix[j];
+        params.seed = seeds[i];
+        nevents = run(&params, cc, line);
+        flows[nruns].params = params;
+        flows[nruns].congestion_control = cc;
+        strcpy(lines[nruns], line);
+        nruns++;
+        run_checkpointed(&params, cc, nevents / 2, resumed);
+        if (strcmp(line, resumed) != 0) {
+          printf("CHECKPOINT MISMATCH\n  resumed:  %s  expected: %s", resumed, line);
+          nfailed++;
+        }
+        if (update) {
+          fputs(line, fp);
+          continue;
+        }
+        if (fgets(golden, sizeof(golden), fp) == NULL || strcmp(line, golden) != 0) {
+          printf("MISMATCH\n  got:      %s  expected: %s", line,
+                 feof(fp) ? "(missing)\n" : golden);
+          nfailed++;
+        }
+      }
+  fclose(fp);
+
+  /* running A and B in parallel does not change the results of a run with
+     streams */
+  for (k=0; k<nruns; k++) {
+    if (!flows[k].params.streams)
+      continue;
+    pdes_run(&flows[k]);
+    describe_stats(&flows[k].params, flows[k].congestion_control, &flows[k].stats, line);
+    if (strcmp(line, lines[k]) != 0) {
+      printf("PARALLEL MISMATCH\n  parallel: %s  expected: %s", line, lines[k]);
+      nfailed++;
+    }
+  }
+
+  /* nor does running the runs as replications, swapped every 100 events */
+  for (k=0; k<nruns; k++)
+    memset(&flows[k].stats, 0, sizeof(flows[k].stats));
+  montecarlo_run(flows, nruns, 100);
+  for (k=0; k<nruns; k++) {
+    describe_stats(&flows[k].params, flows[k].congestion_control, &flows[k].stats, line);
+    if (strcmp(line, lines[k]) != 0) {
+      printf("REPLICATION MISMATCH\n  replicated: %s  expected:   %s", line, lines[k]);
+      nfailed++;
+    }
+  }
+
+  /* a thousand events of each simulation in turn, so that every step
+     swaps one simulation out and the next one in */
+  for (k=0; k<nruns; k++) {
+    config.params = flows[k].params;
+    config.congestion_control = flows[k].congestion_control;
+    sims[k] = sim_create(&config);
+  }
+  do {
+    running = 0;
+    for (k=0; k<nruns; k++)
+      if (sim_run(sims[k], 1000) > 0)
+        running = 1;
+  } while (running);
+  for (k=0; k<nruns; k++) {
+    stats = sim_stats(sims[k]);
+    describe_stats(&flows[k].params, flows[k].congestion_control, &stats, line);
+    if (strcmp(line, lines[k]) != 0) {
+      printf("SIMULATION OBJECT MISMATCH\n  object:   %s  expected: %s", line, lines[k]);
+      nfailed++;
+    }
+    sim_destroy(sims[k]);
+  }
+
+  /* more runs than a new store has room for, so that it grows */
+  storefd = mkstemp(storefile);
+  if (storefd < 0) {
+    printf("unable to create result store\n");
+    exit(EXIT_FAILURE);
+  }
+  close(storefd);    /* an empty file becomes a new store */
+  for (k=0; k<nruns; k++)
+    if (results_append(storefile, protocol_name, &flows[k].params, flows[k].congestion_control,
+                       &flows[k].stats) != 0) {
+      printf("unable to append to result store\n");
+      exit(EXIT_FAILURE);
+    }
+  store = results_open(storefile);
+  if (store == NULL || store->header->nrows != (uint64_t)nruns) {
+    printf("unable to read result store\n");
+    exit(EXIT_FAILURE);
+  }
+  for (k=0; k<nruns; k++) {
+    results_run(store, k, protocol, &params, &cc, &stats);
+    describe_stats(&params, cc, &stats, line);
+    if (strcmp(protocol, protocol_name) != 0 || strcmp(line, lines[k]) != 0) {
+      printf("RESULT STORE MISMATCH\n  stored:   %s %s  expected: %s", protocol, line, lines[k]);
+      nfailed++;
+    }
+  }
+  results_close(store);
+  unlink(storefile);
+
+  if (update)
+    printf("recorded %d runs in %s\n", nruns, argv[optind]);
+  else
+    printf("%d of %d runs match %s\n", nruns - nfailed, nruns, argv[optind]);
+  return nfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,465 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "rng.h"
+
+/* ******************************************************************
+   UDP loopback transport backend.
+
+   Implements the interface of emulator.h (tolayer3, tolayer5,
+   starttimer, stoptimer) on real non-blocking UDP sockets between two
+   ports of 127.0.0.1, driven by epoll and timerfd, so that the
+   wall-clock throughput and CPU cost per packet of the protocol code
+   can be measured.  A and B run in the same process, each with its
+   own socket and timer.
+
+   Time is wall-clock time, in units of -u microseconds, so the
+   protocol's RTT of 16.0 is 16 units.  Loss and corruption are injected
+   in tolayer3 with the emulator's rules; with -d, every packet is also
+   held back for between 0 and the given number of time units, in order.
+
+   usage: udp [-n msgs] [-l loss] [-p corrupt] [-d delay] [-m interval]
+              [-u unit_us] [-t trace] [-s seed] [-N] [-E k]
+   -n msgs      messages to send from A to B (default 100000)
+   -l loss      probability that a packet is dropped (default 0.0)
+   -p corrupt   probability that a packet is corrupted (default 0.0)
+   -d delay     maximum injected one-way delay in time units (default 0.0)
+   -m interval  time units between messages, 0.0 to keep A's window
+                full (default 0.0)
+   -u unit_us   microseconds per time unit (default 100)
+   -t trace     TRACE level (default 0)
+   -s seed      seed of the loss/corruption/delay generator (default 9999)
+   -N           SR only: B sends NAKs for gaps (see sr.c)
+   -E k         GBN only: a parity packet follows every k packets (see gbn.c)
+**********************************************************************/
+
+#define MAXEVENTS 8
+#define MAXDELAYED 1024       /* packets held back by delay injection */
+#define IDLE_TIMEOUT_MS 1000  /* give up when nothing happens for this long */
+
+/* the variables of emulator.h */
+SIMLOCAL int TRACE = 0;
+SIMLOCAL int nak_recovery = 0;
+SIMLOCAL int fec_group = 0;
+SIMLOCAL int flow_control = 0;
+SIMLOCAL int window_full;
+SIMLOCAL int window_occupancy;
+SIMLOCAL int total_ACKs_received;
+SIMLOCAL int packets_resent;
+SIMLOCAL int new_ACKs;
+SIMLOCAL int packets_received;
+SIMLOCAL int fec_parity_sent;
+SIMLOCAL int fec_repaired;
+
+/* event sources registered with epoll */
+#define SOURCE_SOCKET_A  0
+#define SOURCE_SOCKET_B  1
+#define SOURCE_TIMER_A   2
+#define SOURCE_TIMER_B   3
+#define SOURCE_DELAY     4
+#define SOURCE_MESSAGES  5
+
+struct delayed {
+  int AorB;                  /* sender */
+  double sendtime;           /* time at which to send, in time units */
+  struct pkt packet;
+};
+
+static int sock[2];          /* UDP socket of A and B */
+static int timerfd[2];       /* protocol timer of A and B */
+static int timerrunning[2];
+static int delayfd;          /* timer for the first delayed packet */
+static int messagefd;        /* timer for message arrivals */
+
+static struct delayed delayed[MAXDELAYED];  /* FIFO of delayed packets */
+static int delayedfirst, delayedcount;
+static double lastsendtime[2];               /* keeps delayed packets in order */
+
+static struct rng rng;
+static double unit_us = 100.0;
+static float lossprob, corruptprob, maxdelay;
+static struct timespec start;
+
+static int nsim, nsimmax;
+static int ntolayer3, nlost, ncorrupt, nrecvd;
+static int nsendfailed;       /* packets the socket refused, e.g. with a full buffer */
+static int ndropped;          /* timed messages dropped because A's window was full */
+static int messages_delivered;
+
+static double uniform(void)
+{
+  return rng_next(&rng) / (double)RNG_MAX;
+}
+
+static double elapsed_us(const struct timespec *from)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - from->tv_sec) * 1e6 + (now.tv_nsec - from->tv_nsec) / 1e3;
+}
+
+double current_time(void)
+{
+  return elapsed_us(&start) / unit_us;
+}
+
+/* arm a timerfd to go off after the given number of time units, once or periodically */
+static void armtimer(int fd, double units, int periodic)
+{
+  struct itimerspec its;
+  long long ns = (long long)(units * unit_us * 1000.0);
+
+  if (ns <= 0)
+    ns = 1;       /* a zero it_value would disarm the timer */
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = ns / 1000000000LL;
+  its.it_value.tv_nsec = ns % 1000000000LL;
+  if (periodic)
+    its.it_interval = its.it_value;
+  timerfd_settime(fd, 0, &its, NULL);
+}
+
+static void disarmtimer(int fd)
+{
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  timerfd_settime(fd, 0, &its, NULL);
+}
+
+static void sendpacket(int AorB, const struct pkt *packet)
+{
+  if (send(sock[AorB], packet, sizeof(struct pkt), 0) != sizeof(struct pkt)) {
+    nsendfailed++;
+    if (TRACE > 0)
+      printf("          TOLAYER3: send failed: %s\n", strerror(errno));
+  }
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  double x, sendtime;
+  struct delayed *d;
+
+  ntolayer3++;
+
+  /* simulate losses: */
+  if (uniform() < lossprob) {
+    nlost++;
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet being lost\n");
+    return;
+  }
+
+  /* simulate corruption: */
+  if (uniform() < corruptprob) {
+    ncorrupt++;
+    if ((x = uniform()) < .75)
+      packet.payload[0] = 'Z';   /* corrupt payload */
+    else if (x < .875)
+      packet.seqnum = 999999;
+    else
+      packet.acknum = 999999;
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet being corrupted\n");
+  }
+
+  if (maxdelay <= 0.0) {
+    sendpacket(AorB, &packet);
+    return;
+  }
+
+  /* hold the packet back, but never send it before an earlier one */
+  if (delayedcount == MAXDELAYED) {
+    nlost++;
+    return;
+  }
+  sendtime = current_time() + maxdelay * uniform();
+  if (sendtime < lastsendtime[AorB])
+    sendtime = lastsendtime[AorB];
+  lastsendtime[AorB] = sendtime;
+  d = &delayed[(delayedfirst + delayedcount) % MAXDELAYED];
+  d->AorB = AorB;
+  d->sendtime = sendtime;
+  d->packet = packet;
+  delayedcount++;
+  if (delayedcount == 1)
+    armtimer(delayfd, sendtime - current_time(), 0);
+}
+
+/* each packet is still a datagram of its own */
+void tolayer3_burst(int AorB, const struct pkt *packets, int n)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    tolayer3(AorB, packets[i]);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  messages_delivered++;
+}
+
+/* the application consumes every message at once */
+int tolayer5_room(int AorB)
+{
+  return INT_MAX;
+}
+
+void starttimer(int AorB, double increment)
+{
+  if (timerrunning[AorB]) {
+    if (TRACE > 0)
+      printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  timerrunning[AorB] = 1;
+  armtimer(timerfd[AorB], increment, 0);
+}
+
+void stoptimer(int AorB)
+{
+  if (!timerrunning[AorB]) {
+    if (TRACE > 0)
+      printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  timerrunning[AorB] = 0;
+  disarmtimer(timerfd[AorB]);
+}
+
+/********************** Event loop ***********************/
+
+/* give the next message to A; return 0 if its window was full.  A
+   saturated source keeps a rejected message and offers it again later,
+   a timed one loses it like the emulator's. */
+static int givemessage(int saturated)
+{
+  struct msg message;
+  int i, full = window_full;
+
+  for (i=0; i<20; i++)
+    message.data[i] = 97 + nsim % 26;
+  A_output(message);
+  if (window_full != full && saturated) {
+    window_full = full;      /* the message stays with the source */
+    return 0;
+  }
+  if (window_full != full)
+    ndropped++;
+  nsim++;
+  return window_full == full;
+}
+
+/* send the delayed packets that are due, rearm the timer for the next one */
+static void senddelayed(void)
+{
+  struct delayed *d;
+  double now = current_time();
+
+  while (delayedcount > 0) {
+    d = &delayed[delayedfirst];
+    if (d->sendtime > now) {
+      armtimer(delayfd, d->sendtime - now, 0);
+      return;
+    }
+    sendpacket(d->AorB, &d->packet);
+    delayedfirst = (delayedfirst + 1) % MAXDELAYED;
+    delayedcount--;
+  }
+}
+
+static void receive(int AorB)
+{
+  struct pkt packet;
+
+  while (recv(sock[AorB], &packet, sizeof(packet), 0) == sizeof(packet)) {
+    nrecvd++;
+    if (AorB == A)
+      A_input(packet);
+    else
+      B_input(packet);
+  }
+}
+
+static int opensocket(struct sockaddr_in *addr)
+{
+  socklen_t len = sizeof(*addr);
+  int fd;
+
+  fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr->sin_port = 0;
+  if (fd < 0 || bind(fd, (struct sockaddr *)addr, sizeof(*addr)) != 0 ||
+      getsockname(fd, (struct sockaddr *)addr, &len) != 0) {
+    printf("unable to open UDP socket: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+static void watch(int epfd, int fd, int source)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = source;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    printf("epoll_ctl failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void usage(const char *program)
+{
+  printf("usage: %s [-n msgs] [-l loss] [-p corrupt] [-d delay] [-m interval] [-u unit_us] [-t trace] [-s seed] [-N] [-E k]\n", program);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  struct sockaddr_in addr[2];
+  struct epoll_event events[MAXEVENTS];
+  struct timespec cpustart, cpuend;
+  unsigned long long expirations;
+  double interval = 0.0, wall_us, cpu_us;
+  unsigned int seed = 9999;
+  int epfd, n, i, opt, waiting;
+
+  nsimmax = 100000;
+  while ((opt = getopt(argc, argv, "n:l:p:d:m:u:t:s:NE:")) != -1) {
+    switch (opt) {
+    case 'n': nsimmax = atoi(optarg); break;
+    case 'l': lossprob = atof(optarg); break;
+    case 'p': corruptprob = atof(optarg); break;
+    case 'd': maxdelay = atof(optarg); break;
+    case 'm': interval = atof(optarg); break;
+    case 'u': unit_us = atof(optarg); break;
+    case 't': TRACE = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    case 'N':
+      if (strcmp(protocol_name, "sr") != 0) {
+        printf("-N is only implemented by sr\n");
+        usage(argv[0]);
+      }
+      nak_recovery = 1;
+      break;
+    case 'E':
+      if (strcmp(protocol_name, "gbn") != 0) {
+        printf("-E is only implemented by gbn\n");
+        usage(argv[0]);
+      }
+      fec_group = atoi(optarg);
+      break;
+    default: usage(argv[0]);
+    }
+  }
+  rng_seed(&rng, seed);
+
+  sock[A] = opensocket(&addr[A]);
+  sock[B] = opensocket(&addr[B]);
+  if (connect(sock[A], (struct sockaddr *)&addr[B], sizeof(addr[B])) != 0 ||
+      connect(sock[B], (struct sockaddr *)&addr[A], sizeof(addr[A])) != 0) {
+    printf("unable to connect UDP sockets: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  timerfd[A] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  timerfd[B] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  delayfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  messagefd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+  epfd = epoll_create1(0);
+  watch(epfd, sock[A], SOURCE_SOCKET_A);
+  watch(epfd, sock[B], SOURCE_SOCKET_B);
+  watch(epfd, timerfd[A], SOURCE_TIMER_A);
+  watch(epfd, timerfd[B], SOURCE_TIMER_B);
+  watch(epfd, delayfd, SOURCE_DELAY);
+  watch(epfd, messagefd, SOURCE_MESSAGES);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpustart);
+  A_init();
+  B_init();
+  if (interval > 0.0)
+    armtimer(messagefd, interval, 1);
+
+  waiting = 1;   /* the saturated source is waiting for room in A's window */
+  while (messages_delivered + ndropped < nsimmax) {
+    if (interval <= 0.0 && waiting)
+      while (nsim < nsimmax && givemessage(1))
+        ;
+
+    n = epoll_wait(epfd, events, MAXEVENTS, IDLE_TIMEOUT_MS);
+    if (n == 0) {
+      printf("no progress for %d ms, giving up\n", IDLE_TIMEOUT_MS);
+      break;
+    }
+    waiting = 1;
+    for (i=0; i<n; i++) {
+      switch (events[i].data.u32) {
+      case SOURCE_SOCKET_A:
+      case SOURCE_SOCKET_B:
+        receive(events[i].data.u32 == SOURCE_SOCKET_A ? A : B);
+        break;
+      case SOURCE_TIMER_A:
+      case SOURCE_TIMER_B:
+        if (read(timerfd[events[i].data.u32 - SOURCE_TIMER_A], &expirations, sizeof(expirations)) > 0) {
+          timerrunning[events[i].data.u32 - SOURCE_TIMER_A] = 0;
+          if (events[i].data.u32 == SOURCE_TIMER_A)
+            A_timerinterrupt();
+          else
+            B_timerinterrupt();
+        }
+        break;
+      case SOURCE_DELAY:
+        if (read(delayfd, &expirations, sizeof(expirations)) > 0)
+          senddelayed();
+        break;
+      case SOURCE_MESSAGES:
+        if (read(messagefd, &expirations, sizeof(expirations)) > 0)
+          while (expirations-- > 0 && nsim < nsimmax)
+            givemessage(0);
+        break;
+      }
+    }
+  }
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuend);
+  wall_us = elapsed_us(&start);
+  cpu_us = (cpuend.tv_sec - cpustart.tv_sec) * 1e6 + (cpuend.tv_nsec - cpustart.tv_nsec) / 1e3;
+
+  printf("UDP loopback run finished after %f time units (%.3f s)\n", current_time(), wall_us / 1e6);
+  printf("number of messages given to A:  %d \n", nsim);
+  printf("number of messages dropped due to full window:  %d \n", window_full);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
+  printf("number of packet resends by A:  %d \n", packets_resent);
+  printf("number of correct packets received at B:  %d \n", packets_received);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (fec_group > 0)
+    printf("number of parity packets sent by A:  %d, lost packets repaired by parity at B:  %d \n",
+           fec_parity_sent, fec_repaired);
+  printf("packets sent %d (lost %d, corrupted %d, refused by the socket %d), received %d\n",
+         ntolayer3, nlost, ncorrupt, nsendfailed, nrecvd);
+  printf("throughput: %.0f messages/s, %.0f packets/s\n",
+         messages_delivered / (wall_us / 1e6), ntolayer3 / (wall_us / 1e6));
+  if (ntolayer3 > 0)
+    printf("CPU time: %.3f s, %.0f ns per packet sent\n", cpu_us / 1e6, cpu_us * 1e3 / ntolayer3);
+  return EXIT_SUCCESS;
+}
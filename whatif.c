@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "simulator.h"
+
+/* ******************************************************************
+   What-if branching from a checkpoint.
+
+   Reads the simulation parameters from stdin like the emulator, runs
+   the common warm-up up to time T, checkpoints it and then runs every
+   variant from the checkpoint instead of from time 0.  A variant
+   changes the loss and/or corruption probability from time T on.
+
+   usage: whatif [-t time] [-k file] [-r file] [-l loss,...] [-p corrupt,...]
+   -t time        end of the warm-up (default 1000.0)
+   -k file        also write the checkpoint to file
+   -r file        resume from a checkpoint file instead of running a warm-up
+   -l loss,...    loss probabilities of the variants
+   -p corrupt,... corruption probabilities of the variants
+**********************************************************************/
+
+#define MAXVARIANTS 64
+
+/* parse a comma separated list of probabilities, return how many there are */
+static int parse_list(char *arg, float *values)
+{
+  char *tok;
+  int n = 0;
+
+  for (tok = strtok(arg, ","); tok != NULL && n < MAXVARIANTS; tok = strtok(NULL, ","))
+    values[n++] = atof(tok);
+  return n;
+}
+
+int main(int argc, char **argv)
+{
+  struct sim_params params;
+  struct sim_stats stats;
+  struct checkpoint *cp;
+  FILE *fp;
+  const char *savefile = NULL, *resumefile = NULL;
+  double warmup = 1000.0;
+  float losses[MAXVARIANTS], corrupts[MAXVARIANTS];
+  int nlosses = 0, ncorrupts = 0;
+  int i, j, opt;
+
+  while ((opt = getopt(argc, argv, "t:k:r:l:p:")) != -1) {
+    switch (opt) {
+    case 't':
+      warmup = atof(optarg);
+      break;
+    case 'k':
+      savefile = optarg;
+      break;
+    case 'r':
+      resumefile = optarg;
+      break;
+    case 'l':
+      nlosses = parse_list(optarg, losses);
+      break;
+    case 'p':
+      ncorrupts = parse_list(optarg, corrupts);
+      break;
+    default:
+      printf("usage: %s [-t time] [-k file] [-r file] [-l loss,...] [-p corrupt,...]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (resumefile != NULL) {
+    fp = fopen(resumefile, "rb");
+    if (fp == NULL) {
+      printf("unable to open checkpoint file %s\n", resumefile);
+      exit(EXIT_FAILURE);
+    }
+    cp = checkpoint_read(fp);
+    fclose(fp);
+    if (cp == NULL) {
+      printf("%s is not a checkpoint of this emulator and protocol\n", resumefile);
+      exit(EXIT_FAILURE);
+    }
+    checkpoint_restore(cp);
+  }
+  else {
+    init();
+    A_init();
+    B_init();
+    run_until(warmup);
+    cp = checkpoint_save();
+  }
+  get_statistics(&stats);
+  printf("checkpoint at time %f after %ld events\n", stats.time, stats.nevents);
+
+  if (savefile != NULL) {
+    fp = fopen(savefile, "wb");
+    if (fp == NULL || checkpoint_write(cp, fp) != 0) {
+      printf("unable to write checkpoint file %s\n", savefile);
+      exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+  }
+
+  /* the checkpoint's own parameters are the default variant */
+  checkpoint_restore(cp);
+  get_params(&params);
+  if (nlosses == 0)
+    losses[nlosses++] = params.lossprob;
+  if (ncorrupts == 0)
+    corrupts[ncorrupts++] = params.corruptprob;
+
+  for (i=0; i<nlosses; i++)
+    for (j=0; j<ncorrupts; j++) {
+      checkpoint_restore(cp);
+      params.lossprob = losses[i];
+      params.corruptprob = corrupts[j];
+      update_params(&params);
+      run_simulation(-1);
+      get_statistics(&stats);
+      printf("loss %.3f corrupt %.3f: time %f msgs %d delivered %d resent %d new_ACKs %d window_full %d\n",
+             losses[i], corrupts[j], stats.time, stats.nsim, stats.messages_delivered,
+             stats.packets_resent, stats.new_ACKs, stats.window_full);
+    }
+
+  checkpoint_free(cp);
+  return EXIT_SUCCESS;
+}